@@ -18,12 +18,14 @@ firebase.initializeApp({
   messagingSenderId: '538978285523',
 });
 
+// Log entries are step-wise: the device skips samples that haven't changed, so each entry
+// holds until the next one.  Entries are irregularly spaced in time, so they're plotted as
+// {x: time, y} points on a time axis rather than as evenly spaced labels.
 const log = [];
 
 const tempChart = new Chart(document.getElementById('tempLog').getContext('2d'), {
   type: 'line',
   data: {
-    labels: [],
     datasets: [{
       label: 'Pool °F',
       yAxisID: 'y-axis-1',
@@ -31,6 +33,7 @@ const tempChart = new Chart(document.getElementById('tempLog').getContext('2d'),
       borderColor: 'rgba(54,162,235,1)',
       pointRadius: 0,
       pointHitRadius: 4,
+      steppedLine: true,
       data: [],
     }, {
       label: 'Collector °F',
@@ -39,6 +42,7 @@ const tempChart = new Chart(document.getElementById('tempLog').getContext('2d'),
       borderColor: 'rgba(255,99,132,1)',
       pointRadius: 0,
       pointHitRadius: 4,
+      steppedLine: true,
       data: [],
     }, {
       label: 'Collector Active',
@@ -47,6 +51,7 @@ const tempChart = new Chart(document.getElementById('tempLog').getContext('2d'),
       borderColor: 'transparent',
       pointRadius: 0,
       pointHitRadius: 4,
+      steppedLine: true,
       data: [],
     }],
   },
@@ -56,7 +61,7 @@ const tempChart = new Chart(document.getElementById('tempLog').getContext('2d'),
     stacked: false,
     scales: {
       xAxes: [{
-        scaleType: 'linear',
+        type: 'time',
         gridLines: {
           offsetGridLines: false,
         },
@@ -138,9 +143,6 @@ function updateDataSet() {
   updatePending = false;
   const ordered = log.sort((left, right) => left.time - right.time);
 
-  tempChart.data.labels = ordered.map(
-      (sample) => new Date(sample.time).toLocaleString());
-
   const extractTemps = (channel) => {
     tempChart.data.datasets[channel].data = ordered.map((sample) => {
       const adc = sample[channel];
@@ -153,7 +155,7 @@ function updateDataSet() {
       const b = config.bCoefficient;
 
       const c = (1.0 / ((Math.log(r / r0) / b) + (1.0 / t0))) - k;
-      return (c * 1.8 + 32.0).toFixed(2);
+      return { x: sample.time, y: (c * 1.8 + 32.0).toFixed(2) };
     });
   };
 
@@ -161,7 +163,7 @@ function updateDataSet() {
   extractTemps(1);
 
   tempChart.data.datasets[2].data = ordered.map(
-    (sample) => (sample.active ? 1 : 0));
+    (sample) => ({ x: sample.time, y: sample.active ? 1 : 0 }));
 
   tempChart.update();
 }
@@ -0,0 +1,197 @@
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+/*
+ * Clock.h - Millisecond wall clock derived from 'micros64()' and disciplined by NTP.
+ *
+ * The Esp8266 SDK's SNTP client ('sntp_get_current_timestamp()') only has one second resolution.
+ * Periodically, 'poll()' locates the instant the SDK's clock ticks over to a new second and
+ * records the local 'micros64()' at that instant as an anchor.  Between anchors, 'nowMillis()'
+ * is just the elapsed 'micros64()' since the last anchor, corrected by the drift between the
+ * local oscillator and NTP measured across the previous two anchors.
+ *
+ * 'poll()' doesn't busy wait for the tick.  Each call reads the SDK's clock once, and the
+ * second it reports bounds when the tick happened (the bracket.)  Calls land at different points
+ * within the second, so within a few seconds the bracket predicts the next tick to within
+ * '_max_edge_wait_us'.  The first call that lands that close before the predicted tick waits
+ * for it (yielding to the WiFi stack) and records the anchor.
+ *
+ * 'nowMillis()' returns 0 until the first anchor is recorded, which happens asynchronously
+ * once the SNTP client has received its first response (see 'NTPTime::init()').
+ */
+
+extern "C" {
+  #include <sntp.h>
+}
+
+class Clock {
+  private:
+    // How often we re-anchor to the SDK's clock (and re-measure drift.)
+    static const uint32_t _resync_interval_ms = 30 * 60 * 1000;
+
+    // Upper bound on time spent waiting for the SDK's clock to tick over in 'poll()'.  'poll()'
+    // only waits once the bracket predicts the tick will happen within this long.
+    static const int64_t _max_edge_wait_us = 50 * 1000;
+
+    // Largest gap between two reads of the SDK's clock that is accepted as locating its tick.
+    // (A 'yield()' that runs the WiFi stack for longer invalidates the attempt.)
+    static const int64_t _anchor_precision_us = 1000;
+
+    // A local/NTP disagreement larger than this is treated as a step (e.g., the SNTP client
+    // correcting a bad initial time) rather than as oscillator drift.
+    static const int64_t _max_drift_error_us = 2 * 1000 * 1000;
+
+    // Limit on the measured drift, in parts per billion (crystals are typically < 100 ppm.)
+    static const int32_t _max_drift_ppb = 500 * 1000;
+
+    int32_t _gmt_offset_s = 0;          // Offset applied by the SDK to its timestamps.
+
+    bool _valid = false;
+    uint64_t _anchor_us = 0;            // 'micros64()' at the last anchor.
+    uint64_t _anchor_ms = 0;            // UTC milliseconds since 1970 at the last anchor.
+    int32_t _drift_ppb = 0;             // (NTP rate - local rate) / local rate, in parts per billion.
+    uint64_t _next_sync_us = 0;         // 'micros64()' at which 'poll()' will next re-anchor.
+
+    bool _bracketing = false;
+    uint32_t _bracket_seconds = 0;      // SDK timestamp whose start is being located.
+    int64_t _edge_lo_us = 0;            // Bounds ('micros64()') on the start of '_bracket_seconds':
+    int64_t _edge_hi_us = 0;            // '_edge_lo_us' < start <= '_edge_hi_us'.
+
+    // UTC milliseconds at local time 'us', extrapolated from the last anchor.
+    uint64_t toMillis(uint64_t us) const {
+      int64_t elapsed = us - _anchor_us;
+      int64_t corrected = elapsed + (elapsed * _drift_ppb) / 1000000000LL;
+      return _anchor_ms + corrected / 1000;
+    }
+
+    // Local microseconds per NTP second.
+    int64_t secondUs() const {
+      return 1000000 - _drift_ppb / 1000;
+    }
+
+    // Starts a new bracket from the SDK's clock reading 'seconds' at local time 'us'.
+    void startBracket(uint32_t seconds, int64_t us) {
+      _bracketing = true;
+      _bracket_seconds = seconds;
+      _edge_hi_us = us;
+      _edge_lo_us = us - secondUs();
+    }
+
+    // Narrows the bracket given that the SDK's clock read 'seconds' at local time 'us'.  Returns
+    // false if that contradicts the bracket (i.e., the SDK's clock was stepped.)
+    bool narrow(uint32_t seconds, int64_t us) {
+      int64_t second_us = secondUs();
+      int64_t ticks = static_cast<int32_t>(seconds - _bracket_seconds);
+
+      // 'seconds' began at or before 'us', and 'seconds + 1' begins after it.
+      int64_t hi = us - ticks * second_us;
+      int64_t lo = us - (ticks + 1) * second_us;
+      if (hi < _edge_hi_us) { _edge_hi_us = hi; }
+      if (lo > _edge_lo_us) { _edge_lo_us = lo; }
+      return _edge_lo_us < _edge_hi_us;
+    }
+
+    // Waits for the SDK's clock to tick over from 'previous', until local time 'deadline_us'.  On
+    // success, sets 'seconds' to the new SDK timestamp and 'us' to the local time of the tick.
+    bool awaitNextSecond(uint32_t previous, int64_t deadline_us, uint32_t& seconds, uint64_t& us) {
+      uint64_t before = micros64();
+      while (static_cast<int64_t>(before) < deadline_us) {
+        yield();
+        us = micros64();
+        seconds = sntp_get_current_timestamp();
+        if (seconds != previous) {
+          return static_cast<int64_t>(us - before) <= _anchor_precision_us;
+        }
+        before = us;
+      }
+      return false;
+    }
+
+    // Anchors SDK timestamp 'seconds' at local time 'edge_us'.  The error in our extrapolation
+    // since the previous anchor updates the drift.
+    void anchor(uint32_t seconds, uint64_t edge_us) {
+      uint64_t ntp_ms = (static_cast<uint64_t>(seconds) - _gmt_offset_s) * 1000;
+
+      if (_valid) {
+        // Fold the error in our extrapolation since the last anchor into the drift estimate.
+        int64_t error_us = (static_cast<int64_t>(ntp_ms) - static_cast<int64_t>(toMillis(edge_us))) * 1000;
+        int64_t elapsed_us = edge_us - _anchor_us;
+        if (-_max_drift_error_us < error_us && error_us < _max_drift_error_us && elapsed_us > 0) {
+          int64_t drift = _drift_ppb + (error_us * 1000000000LL) / elapsed_us;
+          _drift_ppb = static_cast<int32_t>(constrain(drift, -_max_drift_ppb, _max_drift_ppb));
+        }
+      }
+
+      _anchor_us = edge_us;
+      _anchor_ms = ntp_ms;
+      _next_sync_us = edge_us + static_cast<uint64_t>(_resync_interval_ms) * 1000;
+
+      if (!_valid) {
+        Serial.print("  Clock anchored to NTP: "); Serial.println(static_cast<uint32_t>(seconds - _gmt_offset_s));
+        _valid = true;
+      }
+    }
+
+  public:
+    void init(int8_t gmtOffset) {
+      _gmt_offset_s = static_cast<int32_t>(gmtOffset) * 60 * 60;
+    }
+
+    // Re-anchors to the SDK's clock if a resync is due.  Cheap when no resync is due.  When one
+    // is, narrows the bracket on the SDK's next tick, and waits (for at most '_max_edge_wait_us')
+    // only if the tick is due that soon.
+    void poll() {
+      uint64_t now = micros64();
+      if (_valid && now < _next_sync_us) {
+        return;
+      }
+
+      uint32_t seconds = sntp_get_current_timestamp();
+      if (seconds == 0) {
+        return;     // No response from the NTP server yet.
+      }
+
+      if (!_bracketing || !narrow(seconds, now)) {
+        startBracket(seconds, now);
+        return;
+      }
+
+      // The bracket for the start of '_bracket_seconds', moved forward to the next tick.
+      int64_t next_us = static_cast<int32_t>(seconds - _bracket_seconds + 1) * secondUs();
+      int64_t next_hi_us = _edge_hi_us + next_us;
+      if (next_hi_us - static_cast<int64_t>(now) > _max_edge_wait_us) {
+        return;
+      }
+
+      uint32_t next_seconds;
+      uint64_t edge_us;
+      if (!awaitNextSecond(seconds, now + _max_edge_wait_us, next_seconds, edge_us)) {
+        // Missed (drift moved the tick outside the bracket, or the wait was interrupted for too
+        // long.)  Start over.
+        _bracketing = false;
+        return;
+      }
+
+      anchor(next_seconds, edge_us);
+      _bracketing = false;
+    }
+
+    // True once the clock has been anchored to NTP.
+    bool isValid() const {
+      return _valid;
+    }
+
+    // UTC milliseconds since 1970, or 0 if the clock is not yet valid.
+    uint64_t nowMillis() const {
+      return _valid
+        ? toMillis(micros64())
+        : 0;
+    }
+
+    // The most recently measured drift of the local oscillator relative to NTP (in parts per billion.)
+    int32_t getDriftPpb() const {
+      return _drift_ppb;
+    }
+};
+
+#endif // __CLOCK_H__
@@ -0,0 +1,69 @@
+#ifndef __CLOUD_PROTOCOL_H__
+#define __CLOUD_PROTOCOL_H__
+
+/*
+ * CloudProtocol.h - The sequence of Firebase requests a device makes, without the I/O.
+ *
+ * At boot the device GETs the 'config' object, retrying every '_config_retry_ms' until it
+ * succeeds.  It then writes one sample per polling period to 'log/<n>', making up to
+ * '_max_attempts' attempts with a '_attempt_delay_ms' pause after each.  'n' advances (wrapping
+ * at 'maxEntries') whether or not the write succeeded, so a failed write leaves a stale entry
+ * rather than stalling the ring.
+ *
+ * 'CloudStorage' and firmware.ino carry out these requests on the device.  'tools/fleet-load'
+ * runs the same sequence for many virtual devices to load test the backend.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+class CloudProtocol {
+  public:
+    static const uint8_t  _max_attempts         = 3;        // Attempts to write each log entry.
+    static const uint32_t _attempt_delay_ms     = 100;      // Pause after each attempt to write a log entry.
+    static const uint32_t _config_retry_ms      = 30000;    // Interval between attempts to load the config.
+
+  private:
+    uint32_t _current_entry = 0;        // The log entry being written.
+    uint8_t _attempts = 0;              // Attempts made to write the current entry.
+
+  public:
+    // Path to the configuration object in the Firebase database.  (See 'Config.h' for the
+    // settings it contains.)
+    static const char* configRef() {
+      return "config";
+    }
+
+    // Path to where datapoints are logged in the Firebase database.
+    static const char* logRef() {
+      return "log";
+    }
+
+    // Writes the path of log entry 'entry' (e.g., "log/42") to 'buffer'.
+    static void formatEntryRef(char* buffer, size_t size, uint32_t entry) {
+      snprintf(buffer, size, "%s/%lu", logRef(), static_cast<unsigned long>(entry));
+    }
+
+    // The log entry to write next.
+    uint32_t getEntry() const {
+      return _current_entry;
+    }
+
+    // Records the outcome of an attempt to write the current entry.  Returns true if the write
+    // should be attempted again (after '_attempt_delay_ms'.)  Otherwise the write is finished,
+    // and 'getEntry()' moves on to the next entry.
+    bool completeAttempt(bool success, uint32_t maxEntries) {
+      _attempts++;
+      if (!success && _attempts < _max_attempts) {
+        return true;
+      }
+
+      _attempts = 0;
+      _current_entry = maxEntries > 0
+        ? (_current_entry + 1) % maxEntries
+        : 0;
+      return false;
+    }
+};
+
+#endif // __CLOUD_PROTOCOL_H__
@@ -7,76 +7,30 @@
 //#include <FirebaseError.h>
 #include <FirebaseHttpClient.h>
 #include <FirebaseObject.h>
+#include <memory>
+#include "CloudProtocol.h"
+#include "Config.h"
+#include "JsonReader.h"
+#include "LocalStorage.h"
+#include "RollingStats.h"
 
 class CloudStorage {
   private:
-    // We store as much of the configuration as possible in the cloud so that we can change
-    // these parameters without reflashing the device.  The values below are overwritten by
-    // the value stored the specified path in the Firebase database (if any).
-
-    const char* const _config_ref                   = "config";
-
-    // The fixed resistance of the resistor in the voltage divider (in ohms).
-    const char* const _series_resistor_ref          = "seriesResistor";
-    float   _series_resistor                        = 8170;
-
-    // The resistance of the thermistor (in ohms) at a known temperature.
-    const char* const _resistance_at_0_ref          = "resistanceAt0";
-    float   _resistance_at_0                        = 9555.55;
-    
-    // The temperature at which the resistance of the thermistor was measured.
-    const char* const _temperature_at_0_ref         = "temperatureAt0";
-    float   _temperature_at_0                       = 25;
-
-    // The calculated b-coefficient of the thermistor in the Steinhart-Hart equation.
-    const char* const _b_coefficient_ref            = "bCoefficient";
-    float   _b_coefficient                          = 3380;
-
-    // The frequency at which we make a decision about engaging/disengaging the solar
-    // collector, and at which we log temperature data to the Firebase database.
-    const char* const _polling_milliseconds_ref     = "pollingMilliseconds";
-    int     _polling_milliseconds                   = 5 * 1000;
-
-    // The maximum number of temperature sample points we store in the Firebase database.
-    const char* const _max_entries_ref              = "maxEntries";
-    int     _max_entries                            = 0;
-
-    // The NTP server used to synchronize the 'Time' library.
-    const char* const _ntp_server_ref               = "ntpServer";
-    String  _ntp_server                             = "pool.ntp.org";
-
-    // The GMT offset.  Only used when logging data to the serial monitor.
-    const char* const _gmt_offset_ref               = "gmtOffset";
-    int     _gmt_offset                             = 0;
-
-    // The minimum absolute temperature required to engage the solar collector.  (Used
-    // to prevent engaging the collector during near freezing conditions.)
-    const char* const _min_t_on_ref               = "minTOn";
-    float   _min_t_on                             = 10;
-
-    // The maximum absolute temperature at which to consider engaging the solar
-    // collector. (Used to prevent over-heating the pool.)
-    const char* const _max_t_on_ref               = "maxTOn";
-    float _max_t_on                               = 35;
-    
-    // The minimum temperature delta required to engage the solar collector.
-    const char* const _delta_t_on_ref               = "deltaTOn";
-    float   _delta_t_on                             = 10;
-
-    // The delta at which we will disengage the solar collector.
-    const char* const _delta_t_off_ref             = "deltaTOff";
-    float   _delta_t_off                            = 0;
-
-    // The number of temperature sample points taken and averaged between each iteration
-    // of the polling loop.
-    const char* const _oversample_ref               = "oversample";
-    int     _oversample                             = 16;
-
-    // Path to here datapoints are logged in the Firebase database.
-    const String _log_ref                           = String("log");
-
-    // The current log entry (wraps at '_max_entries'.)
-    uint32_t _current_entry                         = 0;
+    // Firebase host/secret saved by 'init()' for requests we make without the 'Firebase' object.
+    String _firebase_host;
+    String _firebase_auth;
+
+    // The working configuration that 'update()' parses into.  Optional settings missing from the
+    // Firebase database take their built-in defaults.  (Readers use the snapshots published from
+    // it; see 'ConfigSnapshot.h'.)
+    Config _config;
+
+    // 'ConfigSubsystem' flags for settings that have changed since the last call to
+    // 'takeConfigChanges()'.
+    uint8_t _config_changes                         = 0;
+
+    // The current log entry and retry policy (see 'CloudProtocol.h'.)
+    CloudProtocol _protocol;
 
     // Convenience method used to log 'FAILED' and return false (leading to an early exit)
     // when 'Firebase.failed()' returns true.
@@ -88,76 +42,175 @@ class CloudStorage {
       
       return false;
     }
-    
-    // Template used by 'Firebase_maybeUpdate*()' (below) to update the 'value' with the
-    // value stored at 'path', if we're able to successfully retrieve it.  Otherwise, return
-    // false and leave 'value' unmodified.
-    //
-    // This was used during development to fallback on built-in default values before
-    // the Firebase database was populated.
-    template <typename T> bool maybeUpdate(T (*getFn)(FirebaseObject& obj, const String& path), FirebaseObject& obj, const char* const path, T& value) {
-      Serial.print("  Accessing '"); Serial.print(path); Serial.print("': ");
-      T maybeNewValue = getFn(obj, path);
-      if (failed()) {
+
+    // Adapts the HTTP response body to the 'JsonReader' source interface.  Each read blocks
+    // for at most the stream's timeout.
+    class BodySource {
+      private:
+        Stream& _stream;
+        size_t _bytes = 0;
+
+      public:
+        BodySource(Stream& stream) : _stream(stream) { }
+
+        int read() {
+          char ch;
+          if (_stream.readBytes(&ch, 1) != 1) {
+            return -1;
+          }
+          _bytes++;
+          return static_cast<uint8_t>(ch);
+        }
+
+        // Number of bytes of the body read so far.
+        size_t getBytes() const {
+          return _bytes;
+        }
+    };
+
+    // Estimated heap a 'FirebaseObject' would hold for a body of 'bodyBytes': the response
+    // 'String', the copy 'FirebaseObject' parses in place, and its
+    // 'StaticJsonBuffer<JSON_OBJECT_SIZE(32)>'.  This is computed from those sizes, not measured
+    // (allocator overhead and 'String' growth are not included), so it is a lower bound on the
+    // saving over the DOM path 'update()' replaced.
+    static size_t estimateFirebaseObjectHeap(size_t bodyBytes) {
+      return 2 * (bodyBytes + 1) + sizeof(StaticJsonBuffer<JSON_OBJECT_SIZE(32)>);
+    }
+
+    // Updates the setting 'key' with the value whose first token is 'token', if it is a valid
+    // scalar.  Otherwise, returns false and leaves the setting unmodified.
+    template <typename Reader> bool maybeUpdate(Reader& reader, JsonToken token, ConfigKey key) {
+      Serial.print("  Accessing '"); Serial.print(Config::describe(key).key); Serial.print("': ");
+
+      if ((token != JSON_NUMBER && token != JSON_STRING) || reader.isTruncated()) {
+        reader.skipValue(token);
+        Serial.println("[INVALID]");
         return false;
       }
 
-      value = maybeNewValue;
-      Serial.println(value);
+      if (!_config.set(key, reader.text(), _config_changes)) {
+        Serial.print("[INVALID] "); Serial.println(reader.text());
+        return false;
+      }
+
+      Serial.println(reader.text());
       return true;
-    };
+    }
 
-    // Thunks w/known addresses so we can create function pointers.
-    static int Firebase_getInt(FirebaseObject& obj, const String& path) { return obj.getInt(path); }
-    static float Firebase_getFloat(FirebaseObject& obj, const String& path) { return obj.getFloat(path); }
-    static String Firebase_getString(FirebaseObject& obj, const String& path) { return obj.getString(path); }
+    // Parses the 'config' object from 'reader' straight into '_config', one member at a time.
+    // Unknown keys are skipped, and missing 'CONFIG_OPTIONAL' settings take their built-in
+    // defaults.  Returns false if the JSON is malformed, or if any setting is invalid or is
+    // missing and 'CONFIG_REQUIRED' (in which case that setting keeps its previous value.)
+    //
+    // 'minFreeHeap' is lowered to the smallest free heap observed while parsing.
+    template <typename Reader> bool parseConfig(Reader& reader, uint32_t& minFreeHeap) {
+      if (reader.next() != JSON_BEGIN_OBJECT) {
+        Serial.println("  [MALFORMED]");
+        return false;
+      }
 
-    // Updates 'value' with the Firebase value at 'path', if any.  Otherwise leaves
-    // 'value' unmodified and returns false.
-    bool maybeUpdateInt(FirebaseObject& obj, const char* const path, int& value) {
-      return maybeUpdate<int>(Firebase_getInt, obj, path, value);
-    }
-    
-    // Updates 'value' with the Firebase value at 'path', if any.  Otherwise leaves
-    // 'value' unmodified and returns false.
-    bool maybeUpdateFloat(FirebaseObject& obj, const char* const path, float& value) {
-      return maybeUpdate<float>(Firebase_getFloat, obj, path, value);
+      static_assert(CONFIG_KEY_COUNT <= 32, "'seen' requires one bit per setting.");
+
+      bool success = true;
+      uint32_t seen = 0;
+
+      JsonToken token;
+      while ((token = reader.next()) == JSON_KEY) {
+        minFreeHeap = min(minFreeHeap, ESP.getFreeHeap());
+
+        ConfigKey key = Config::find(reader.text());
+        token = reader.next();
+
+        if (key == CONFIG_KEY_COUNT) {
+          success &= reader.skipValue(token);
+          continue;
+        }
+
+        seen |= 1UL << key;
+        success &= maybeUpdate(reader, token, key);
+      }
+
+      if (token != JSON_END_OBJECT) {
+        Serial.println("  [MALFORMED]");
+        return false;
+      }
+
+      for (uint8_t i = 0; i < CONFIG_KEY_COUNT; i++) {
+        if ((seen & (1UL << i)) != 0) {
+          continue;
+        }
+
+        ConfigKey key = static_cast<ConfigKey>(i);
+        ConfigDescriptor descriptor = Config::describe(key);
+        Serial.print("  Accessing '"); Serial.print(descriptor.key); Serial.print("': ");
+        if (descriptor.presence == CONFIG_REQUIRED) {
+          Serial.println("[MISSING]");
+          success = false;
+          continue;
+        }
+
+        bool isValid = _config.set(key, descriptor.defaultValue, _config_changes);
+        assert(isValid);
+        Serial.print("[DEFAULT] "); Serial.println(descriptor.defaultValue);
+      }
+
+      return success;
     }
 
-    // Updates 'value' with the Firebase value at 'path', if any.  Otherwise leaves
-    // 'value' unmodified and returns false.
-    bool maybeUpdateString(FirebaseObject& obj, const char* const path, String& value) {
-      return maybeUpdate<String>(Firebase_getString, obj, path, value);
+    // Formats 'value' as decimal digits at the end of 'buffer' (which must hold at least
+    // 21 chars) and returns a pointer to the first digit.
+    static const char* toDecimal(uint64_t value, char* buffer) {
+      char* digits = buffer + 20;
+      *digits = '\0';
+      do {
+        *--digits = '0' + (value % 10);
+        value /= 10;
+      } while (value > 0);
+      return digits;
     }
 
   public:
     // Updates cached configuration with values from Firebase.
+    //
+    // The response is parsed as it arrives from the network rather than being buffered into a
+    // 'FirebaseObject', so the heap cost is the HTTP client and a fixed size scratch buffer,
+    // independent of the size of the 'config' object.
     bool update(Device& device) {
-      bool success = true;
-
       Serial.print("Updating config from Firebase: ");
       device.blinkLed(25);
 
-      FirebaseObject configObj = Firebase.get(_config_ref);
-      if (configObj.failed()) {
+      uint32_t startFreeHeap = ESP.getFreeHeap();
+      uint32_t minFreeHeap = startFreeHeap;
+
+      std::unique_ptr<FirebaseHttpClient> http(FirebaseHttpClient::create());
+      http->setReuseConnection(false);
+      http->begin(_firebase_host.c_str(), (String("/") + CloudProtocol::configRef() + ".json?auth=" + _firebase_auth).c_str());
+      minFreeHeap = min(minFreeHeap, ESP.getFreeHeap());
+
+      // The TLS session's buffers are allocated by the handshake in 'sendRequest()' and held
+      // until 'end()', so sampling after the request captures them.
+      int status = http->sendRequest("GET", "");
+      minFreeHeap = min(minFreeHeap, ESP.getFreeHeap());
+      uint32_t requestFreeHeap = minFreeHeap;
+      if (status != 200) {
+        Serial.print("[FAILED] "); Serial.println(status);
+        http->end();
         return false;
       }
-      
-      configObj.getJsonVariant().printTo(Serial); Serial.println();
-
-      success &= maybeUpdateFloat(configObj, _series_resistor_ref, _series_resistor);
-      success &= maybeUpdateFloat(configObj, _temperature_at_0_ref, _temperature_at_0);
-      success &= maybeUpdateFloat(configObj, _resistance_at_0_ref, _resistance_at_0);
-      success &= maybeUpdateFloat(configObj, _b_coefficient_ref, _b_coefficient);
-      success &= maybeUpdateInt(configObj,_polling_milliseconds_ref, _polling_milliseconds);
-      success &= maybeUpdateInt(configObj, _max_entries_ref, _max_entries);
-      success &= maybeUpdateString(configObj, _ntp_server_ref, _ntp_server);
-      success &= maybeUpdateInt(configObj, _gmt_offset_ref, _gmt_offset);
-      success &= maybeUpdateFloat(configObj, _delta_t_on_ref, _delta_t_on);
-      success &= maybeUpdateFloat(configObj, _delta_t_off_ref, _delta_t_off);
-      success &= maybeUpdateFloat(configObj, _min_t_on_ref, _min_t_on);
-      success &= maybeUpdateFloat(configObj, _max_t_on_ref, _max_t_on);
-      success &= maybeUpdateInt(configObj, _oversample_ref, _oversample);
+      Serial.println("[OK]");
+
+      BodySource source(*http->getStreamPtr());
+      JsonReader<BodySource> reader(source);
+      bool success = parseConfig(reader, minFreeHeap);
+      minFreeHeap = min(minFreeHeap, ESP.getFreeHeap());
+      http->end();
+
+      Serial.print("  Effective config: "); _config.printTo(Serial); Serial.println();
+      Serial.print("  Peak heap used by config load: "); Serial.print(startFreeHeap - minFreeHeap);
+      Serial.print(" bytes (request: "); Serial.print(startFreeHeap - requestFreeHeap);
+      Serial.print(", parsing: "); Serial.print(requestFreeHeap - minFreeHeap);
+      Serial.print("; estimated, not measured: a FirebaseObject would add >= "); Serial.print(estimateFirebaseObjectHeap(source.getBytes()));
+      Serial.print(" for this "); Serial.print(source.getBytes()); Serial.println(" byte body)");
       device.setLed(true);
 
       return success;
@@ -167,67 +220,43 @@ class CloudStorage {
     bool init(const String& firebase_host, const String& firebase_auth) {
       Serial.print("Conecting to Firebase '"); Serial.print(firebase_host); Serial.print("': ");
 
+      _firebase_host = firebase_host;
+      _firebase_auth = firebase_auth;
+
       Firebase.begin(firebase_host, firebase_auth);
       if (!failed()) {
         Serial.println("[OK]");
       }
     }
 
-    // The frequency at which we make a decision about engaging/disengaging the solar
-    // collector, and at which we log temperature data to the Firebase database.
-    int getPollingMilliseconds() const {
-      return _polling_milliseconds;
-    }
-
-    // The fixed resistance of the resistor in the voltage divider (in ohms).
-    double getSeriesResistor() const {
-      return _series_resistor;
-    }
-
-    double getResistanceAt0() const {
-      return _resistance_at_0;
-    }
-
-    double getTemperatureAt0() const {
-      return _temperature_at_0;
-    }
-
-    double getBCoefficient() const {
-      return _b_coefficient;
-    }
-
-    double getMinTOn() const {
-      return _min_t_on;
-    }
-
-    double getMaxTOn() const {
-      return _max_t_on;
-    }
+    // Replaces the working configuration with the last good config saved in 'storage' (see
+    // 'LocalStorage::saveCloudConfig()'), for use until 'update()' succeeds.  Returns false if
+    // there was none, in which case the working configuration is reset to the built-in defaults.
+    bool restoreConfig(LocalStorage& storage) {
+      if (!storage.loadCloudConfig(_config, _config_changes)) {
+        _config.reset();
+        return false;
+      }
 
-    double getDeltaTOn() const {
-      return _delta_t_on;
+      Serial.print("  Restored config: "); _config.printTo(Serial); Serial.println();
+      return true;
     }
 
-    double getDeltaTOff() const {
-      return _delta_t_off;
-    }
-    
-    double getOversample() const {
-      return _oversample;
-    }
-    
-    const char* const getNtpServer() const {
-      return _ntp_server.c_str();
+    // The working configuration (see 'ConfigStore::publish()'.)
+    const Config& getConfig() const {
+      return _config;
     }
 
-    int8_t getGmtOffset() const {
-      assert(-11 <= _gmt_offset && _gmt_offset <= 13);
-      
-      return static_cast<int8_t>(_gmt_offset);
+    // Returns the 'ConfigSubsystem' flags for the settings that have changed since the previous
+    // call, and clears them.
+    uint8_t takeConfigChanges() {
+      uint8_t changes = _config_changes;
+      _config_changes = 0;
+      return changes;
     }
 
     void pushLogInt(String name, int value) {
-      String slotRef = _log_ref + "/" + name + "/" + _current_entry;
+      String slotRef = String(CloudProtocol::logRef()) + "/" + name + "/" + _protocol.getEntry();
 
       Serial.print("  Logging '"); Serial.print(slotRef); Serial.print("': ");
 
@@ -245,7 +274,15 @@ class CloudStorage {
       }
     }
 
-    void log(Device& device, time_t timestamp, double adc0, double adc1, bool active) {
+    // Logs a sample to the next entry.  'timestamp' is the time the sample was taken in UTC
+    // milliseconds since 1970.  If 'timestamp' is 0 (i.e., our clock is not yet synchronized),
+    // the Firebase server's timestamp is used instead.  'trend0' and 'trend1' are each channel's
+    // rate of change and noise (see 'RollingStats.h'.)  'skipped' is the number of unchanged
+    // samples suppressed since the previous entry (see 'UploadFilter.h'.)  'maxEntries' is the
+    // 'MAX_ENTRIES' setting from the caller's config snapshot.  Returns false if the entry could
+    // not be written.
+    bool log(Device& device, uint64_t timestamp, double adc0, double adc1, bool active,
+             const Trend& trend0, const Trend& trend1, uint32_t skipped, uint32_t maxEntries) {
       device.blinkLed(19);
 
       DynamicJsonBuffer _json_buffer;
@@ -253,24 +290,37 @@ class CloudStorage {
       root["0"] = adc0;
       root["1"] = adc1;
       root["active"] = active;
-
-      JsonObject& time = _json_buffer.createObject();
-      time[".sv"] = "timestamp";
-      root["time"] = time;
+      root["skipped"] = skipped;
+      root["rate0"] = trend0.perHour;
+      root["rate1"] = trend1.perHour;
+      root["noise0"] = trend0.noise;
+      root["noise1"] = trend1.noise;
+
+      // Millisecond timestamps exceed 32 bits, so we write the digits ourselves rather than rely
+      // on ArduinoJson's 64-bit integer support.  ('timestampText' must outlive 'root'.)
+      char timestampText[21];
+      if (timestamp > 0) {
+        root["time"] = RawJson(toDecimal(timestamp, timestampText));
+      } else {
+        JsonObject& time = _json_buffer.createObject();
+        time[".sv"] = "timestamp";
+        root["time"] = time;
+      }
       
-      String slotRef = _log_ref + "/" + _current_entry;
+      char slotRef[24];
+      CloudProtocol::formatEntryRef(slotRef, sizeof(slotRef), _protocol.getEntry());
 
       Serial.print("  Logging '"); Serial.print(slotRef); Serial.print("': ");
 
-      bool fail = true;
-      for (int i = 0; fail && i < 3; i++) {
+      bool fail;
+      do {
         Firebase.set(slotRef, root);
         fail = failed();
         if (fail) {
           Serial.print("  ... ");
         }
-        delay(100);
-      }
+        delay(CloudProtocol::_attempt_delay_ms);
+      } while (_protocol.completeAttempt(!fail, maxEntries));
 
       if (!fail) {
         root.printTo(Serial); Serial.println();
@@ -278,8 +328,9 @@ class CloudStorage {
         Serial.println(Firebase.error());
       }
 
-      _current_entry = (_current_entry + 1) % _max_entries;
       device.setLed(true);
+
+      return !fail;
     }
 };
 
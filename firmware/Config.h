@@ -0,0 +1,350 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+/*
+ * Config.h - Schema and storage for the configuration we load from the Firebase 'config' object.
+ *
+ * Each setting is described by one row in '_config_schema' (below): its key in the Firebase
+ * database, its type, its built-in default, its valid range and the subsystems that must be
+ * notified when it changes.  The table lives in flash (PROGMEM), so adding a setting costs one
+ * row of flash plus the 4 bytes used to hold its value in RAM.
+ *
+ * To add a setting, add a 'ConfigKey' and the corresponding row to '_config_schema'.  New
+ * settings should be 'CONFIG_OPTIONAL', so that existing 'config' objects remain valid.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pgmspace.h>
+
+// The types of values we store.  Numbers are parsed from their JSON text, strings are stored
+// without their quotes.
+typedef enum : uint8_t {
+  CONFIG_INT = 0,
+  CONFIG_FLOAT,
+  CONFIG_STRING,
+} ConfigType;
+
+// Whether 'CloudStorage::update()' fails when a setting is missing from the Firebase 'config'
+// object.  A missing optional setting takes its built-in default.
+typedef enum : uint8_t {
+  CONFIG_REQUIRED = 0,
+  CONFIG_OPTIONAL,
+} ConfigPresence;
+
+// Flags identifying the subsystems that depend on a setting.  'CloudStorage::update()' ORs
+// together the flags of every setting whose value changed.
+typedef enum : uint8_t {
+  SUBSYSTEM_THERMISTOR  = 1 << 0,     // Steinhart-Hart parameters (see 'Thermistor::init()').
+  SUBSYSTEM_CONTROL     = 1 << 1,     // Thresholds used by 'getShouldEngageCollector()'.
+  SUBSYSTEM_SAMPLING    = 1 << 2,     // Polling period and oversampling in 'loop()'.
+  SUBSYSTEM_LOG         = 1 << 3,     // Cloud logging.
+  SUBSYSTEM_TIME        = 1 << 4,     // NTP synchronization.
+
+  SUBSYSTEM_ALL         = 0xFF,
+} ConfigSubsystem;
+
+// Index of each setting in '_config_schema'.  String valued settings must follow all of the
+// numeric settings, starting at 'CONFIG_FIRST_STRING'.
+typedef enum : uint8_t {
+  SERIES_RESISTOR = 0,
+  RESISTANCE_AT_0,
+  TEMPERATURE_AT_0,
+  B_COEFFICIENT,
+  POLLING_MILLISECONDS,
+  MAX_ENTRIES,
+  GMT_OFFSET,
+  MIN_T_ON,
+  MAX_T_ON,
+  DELTA_T_ON,
+  DELTA_T_OFF,
+  OVERSAMPLE,
+  UPLOAD_DEADBAND,
+  HEARTBEAT_MILLISECONDS,
+  STATS_WINDOW_SECONDS,
+
+  NTP_SERVER,
+
+  CONFIG_KEY_COUNT,
+  CONFIG_FIRST_STRING = NTP_SERVER,
+} ConfigKey;
+
+typedef struct {
+  char key[24];               // Name of the setting in the Firebase 'config' object.
+  char defaultValue[16];      // Built-in default, written as it would appear in the JSON.
+  ConfigType type;
+  ConfigPresence presence;
+  uint8_t subsystems;         // 'ConfigSubsystem' flags for the code that depends on this setting.
+  float minValue;             // Inclusive range of valid values.  (For strings, the valid length.)
+  float maxValue;
+} ConfigDescriptor;
+
+// We store as much of the configuration as possible in the cloud so that we can change
+// these parameters without reflashing the device.  The defaults below are overwritten by
+// the value stored in the Firebase database (if any).
+static const ConfigDescriptor _config_schema[CONFIG_KEY_COUNT] PROGMEM = {
+  // The fixed resistance of the resistor in the voltage divider (in ohms).
+  { "seriesResistor",       "8170",         CONFIG_FLOAT,   CONFIG_REQUIRED, SUBSYSTEM_THERMISTOR, 1,    1e7 },
+
+  // The resistance of the thermistor (in ohms) at a known temperature.
+  { "resistanceAt0",        "9555.55",      CONFIG_FLOAT,   CONFIG_REQUIRED, SUBSYSTEM_THERMISTOR, 1,    1e7 },
+
+  // The temperature at which the resistance of the thermistor was measured.
+  { "temperatureAt0",       "25",           CONFIG_FLOAT,   CONFIG_REQUIRED, SUBSYSTEM_THERMISTOR, -50,  150 },
+
+  // The calculated b-coefficient of the thermistor in the Steinhart-Hart equation.
+  { "bCoefficient",         "3380",         CONFIG_FLOAT,   CONFIG_REQUIRED, SUBSYSTEM_THERMISTOR, 1,    1e5 },
+
+  // The frequency at which we make a decision about engaging/disengaging the solar
+  // collector, and at which we log temperature data to the Firebase database.
+  { "pollingMilliseconds",  "5000",         CONFIG_INT,     CONFIG_REQUIRED, SUBSYSTEM_SAMPLING,   100,  36e5 },
+
+  // The maximum number of temperature sample points we store in the Firebase database.
+  { "maxEntries",           "0",            CONFIG_INT,     CONFIG_REQUIRED, SUBSYSTEM_LOG,        0,    1e6 },
+
+  // The GMT offset.  Only used when logging data to the serial monitor.
+  { "gmtOffset",            "0",            CONFIG_INT,     CONFIG_REQUIRED, SUBSYSTEM_TIME,       -11,  13 },
+
+  // The minimum absolute temperature required to engage the solar collector.  (Used
+  // to prevent engaging the collector during near freezing conditions.)
+  { "minTOn",               "10",           CONFIG_FLOAT,   CONFIG_REQUIRED, SUBSYSTEM_CONTROL,    -50,  150 },
+
+  // The maximum absolute temperature at which to consider engaging the solar
+  // collector. (Used to prevent over-heating the pool.)
+  { "maxTOn",               "35",           CONFIG_FLOAT,   CONFIG_REQUIRED, SUBSYSTEM_CONTROL,    -50,  150 },
+
+  // The minimum temperature delta required to engage the solar collector.
+  { "deltaTOn",             "10",           CONFIG_FLOAT,   CONFIG_REQUIRED, SUBSYSTEM_CONTROL,    -100, 100 },
+
+  // The delta at which we will disengage the solar collector.
+  { "deltaTOff",            "0",            CONFIG_FLOAT,   CONFIG_REQUIRED, SUBSYSTEM_CONTROL,    -100, 100 },
+
+  // The number of temperature sample points taken and averaged between each iteration
+  // of the polling loop.
+  { "oversample",           "16",           CONFIG_INT,     CONFIG_REQUIRED, SUBSYSTEM_SAMPLING,   1,    1024 },
+
+  // Samples are only logged when a channel's ADC average moves by more than this many codes
+  // from the last logged sample (or the relay changes state.)  0 logs every sample.
+  { "uploadDeadband",       "0",            CONFIG_FLOAT,   CONFIG_OPTIONAL, SUBSYSTEM_LOG,        0,    1023 },
+
+  // The maximum time between logged samples when the deadband suppresses uploads.
+  { "heartbeatMilliseconds", "300000",      CONFIG_INT,     CONFIG_OPTIONAL, SUBSYSTEM_LOG,        1000, 864e5 },
+
+  // The time constant of the trend statistics (rate of change and noise) in 'RollingStats.h'.
+  { "statsWindowSeconds",   "900",          CONFIG_FLOAT,   CONFIG_OPTIONAL, SUBSYSTEM_SAMPLING,   10,   864e2 },
+
+  // The NTP server used to synchronize the 'Time' library.
+  { "ntpServer",            "pool.ntp.org", CONFIG_STRING,  CONFIG_REQUIRED, SUBSYSTEM_TIME,       1,    63 },
+};
+
+class Config {
+  public:
+    static const size_t _max_string_length = 63;
+
+  private:
+    typedef union {
+      int32_t _int;
+      float   _float;
+    } NumericValue;
+
+    NumericValue _numbers[CONFIG_FIRST_STRING];
+    char _strings[CONFIG_KEY_COUNT - CONFIG_FIRST_STRING][_max_string_length + 1];
+
+    static bool isNumeric(ConfigKey key) {
+      return key < CONFIG_FIRST_STRING;
+    }
+
+    // Parses 'text' as a number of the given 'type', returning false if 'text' is not entirely
+    // a number.
+    static bool parseNumber(ConfigType type, const char* text, NumericValue& value) {
+      char* end;
+      if (type == CONFIG_INT) {
+        value._int = strtol(text, &end, 10);
+      } else {
+        value._float = strtod(text, &end);
+      }
+      return end != text && *end == '\0';
+    }
+
+    // Last line written by 'saveTo()'.
+    static const char* endMarker() {
+      return "end";
+    }
+
+  public:
+    Config() {
+      reset();
+    }
+
+    // Copies the schema row for 'key' out of flash.
+    static ConfigDescriptor describe(ConfigKey key) {
+      assert(key < CONFIG_KEY_COUNT);
+
+      ConfigDescriptor descriptor;
+      memcpy_P(&descriptor, &_config_schema[key], sizeof(descriptor));
+      return descriptor;
+    }
+
+    // Returns the 'ConfigKey' whose name is 'name', or 'CONFIG_KEY_COUNT' if there is none.
+    static ConfigKey find(const char* name) {
+      for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++) {
+        if (strcmp_P(name, _config_schema[key].key) == 0) {
+          return static_cast<ConfigKey>(key);
+        }
+      }
+      return CONFIG_KEY_COUNT;
+    }
+
+    // Restores every setting to its built-in default.
+    void reset() {
+      uint8_t ignored = 0;
+      for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++) {
+        bool success = set(static_cast<ConfigKey>(key), describe(static_cast<ConfigKey>(key)).defaultValue, ignored);
+        assert(success);
+      }
+    }
+
+    // Parses 'text' and validates it against the schema for 'key'.  If valid, stores the value,
+    // ORs the setting's subsystems into 'changed' if the value differs from the previous value,
+    // and returns true.  Otherwise returns false and leaves the setting unmodified.
+    bool set(ConfigKey key, const char* text, uint8_t& changed) {
+      ConfigDescriptor descriptor = describe(key);
+
+      if (descriptor.type == CONFIG_STRING) {
+        size_t length = strlen(text);
+        if (length < descriptor.minValue || length > descriptor.maxValue || length > _max_string_length) {
+          return false;
+        }
+
+        char* value = _strings[key - CONFIG_FIRST_STRING];
+        if (strcmp(value, text) != 0) {
+          strcpy(value, text);
+          changed |= descriptor.subsystems;
+        }
+        return true;
+      }
+
+      NumericValue value;
+      if (!parseNumber(descriptor.type, text, value)) {
+        return false;
+      }
+
+      float asFloat = descriptor.type == CONFIG_INT ? value._int : value._float;
+      if (!(descriptor.minValue <= asFloat && asFloat <= descriptor.maxValue)) {
+        return false;
+      }
+
+      if (memcmp(&_numbers[key], &value, sizeof(value)) != 0) {
+        _numbers[key] = value;
+        changed |= descriptor.subsystems;
+      }
+      return true;
+    }
+
+    int32_t getInt(ConfigKey key) const {
+      assert(isNumeric(key));
+      return describe(key).type == CONFIG_INT
+        ? _numbers[key]._int
+        : static_cast<int32_t>(_numbers[key]._float);
+    }
+
+    float getFloat(ConfigKey key) const {
+      assert(isNumeric(key));
+      return describe(key).type == CONFIG_FLOAT
+        ? _numbers[key]._float
+        : static_cast<float>(_numbers[key]._int);
+    }
+
+    const char* getString(ConfigKey key) const {
+      assert(!isNumeric(key));
+      return _strings[key - CONFIG_FIRST_STRING];
+    }
+
+    // Writes the current settings to 'out' as a JSON object (used for logging to the serial monitor).
+    void printTo(Print& out) const {
+      out.print('{');
+      for (uint8_t i = 0; i < CONFIG_KEY_COUNT; i++) {
+        ConfigKey key = static_cast<ConfigKey>(i);
+        ConfigDescriptor descriptor = describe(key);
+
+        if (i > 0) { out.print(','); }
+        out.print('"'); out.print(descriptor.key); out.print("\":");
+
+        switch (descriptor.type) {
+          case CONFIG_INT:    out.print(getInt(key)); break;
+          case CONFIG_FLOAT:  out.print(getFloat(key)); break;
+          case CONFIG_STRING: out.print('"'); out.print(getString(key)); out.print('"'); break;
+        }
+      }
+      out.print('}');
+    }
+
+    // Writes every setting to 'out' as one 'key=value' line per row of the schema (used to
+    // persist the last good config; see 'LocalStorage::saveCloudConfig()'.)  Floats are written
+    // with 6 decimal places, which reads back the same value for settings of 1 or more.  The
+    // last line is 'endMarker()', so that 'loadFrom()' can tell a complete copy from one that
+    // was cut short.
+    void saveTo(Print& out) const {
+      for (uint8_t i = 0; i < CONFIG_KEY_COUNT; i++) {
+        ConfigKey key = static_cast<ConfigKey>(i);
+        ConfigDescriptor descriptor = describe(key);
+
+        out.print(descriptor.key); out.print('=');
+        switch (descriptor.type) {
+          case CONFIG_INT:    out.print(getInt(key)); break;
+          case CONFIG_FLOAT:  out.print(getFloat(key), 6); break;
+          case CONFIG_STRING: out.print(getString(key)); break;
+        }
+        out.print('\n');
+      }
+      out.print(endMarker()); out.print('\n');
+    }
+
+    // Reads lines written by 'saveTo()' from 'in', validating each against the schema as 'set()'
+    // does (and ORing the subsystems of changed settings into 'changed'.)  Unknown keys are
+    // ignored, so settings removed from the schema don't invalidate a saved config.  Returns
+    // false if any line is malformed or invalid, if a 'CONFIG_REQUIRED' setting is missing, or
+    // if the copy is incomplete (no 'endMarker()'.)
+    bool loadFrom(Stream& in, uint8_t& changed) {
+      static_assert(CONFIG_KEY_COUNT <= 32, "'seen' requires one bit per setting.");
+
+      bool success = true;
+      bool complete = false;
+      uint32_t seen = 0;
+      char line[sizeof(ConfigDescriptor::key) + _max_string_length + 2];
+
+      while (in.available() > 0) {
+        size_t length = in.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[length] = '\0';
+
+        if (strcmp(line, endMarker()) == 0) {
+          complete = true;
+          continue;
+        }
+
+        char* value = strchr(line, '=');
+        if (value == nullptr) {
+          success = false;
+          continue;
+        }
+        *value++ = '\0';
+
+        ConfigKey key = find(line);
+        if (key != CONFIG_KEY_COUNT) {
+          seen |= 1UL << key;
+          success &= set(key, value, changed);
+        }
+      }
+
+      for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++) {
+        if ((seen & (1UL << key)) == 0 && describe(static_cast<ConfigKey>(key)).presence == CONFIG_REQUIRED) {
+          success = false;
+        }
+      }
+
+      return success && complete;
+    }
+};
+
+#endif // __CONFIG_H__
@@ -0,0 +1,95 @@
+#ifndef __CONFIG_SNAPSHOT_H__
+#define __CONFIG_SNAPSHOT_H__
+
+/*
+ * ConfigSnapshot.h - Immutable, versioned copies of the configuration and the state derived
+ * from it.
+ *
+ * 'CloudStorage::update()' parses into its own working 'Config'.  'ConfigStore::publish()'
+ * copies that into the idle half of a double buffer, rebuilds the derived state there
+ * (Steinhart-Hart coefficients, control thresholds and safety cutoff ADC thresholds), then
+ * swaps the published pointer.  Readers call 'current()' once (a single pointer load, with no
+ * locks or interrupt masking) and use that snapshot for the whole decision, so they never see
+ * a mix of old and new settings.
+ *
+ * There is a single writer ('loop()'.)  A buffer is rebuilt by the publish after the one that
+ * retired it, so a reader that may hold a snapshot across two publishes (e.g., an interrupt
+ * handler) must validate what it read, seqlock style: take 'beginRead()' before reading and
+ * retry unless 'isUnchanged()' after.  'sequence' is odd while its buffer is being rebuilt.
+ */
+
+#include <atomic>
+#include "Config.h"
+#include "Controller.h"
+#include "SafetyCutoff.h"
+#include "Thermistor.h"
+
+struct ConfigSnapshot {
+  std::atomic<uint32_t> sequence;             // Odd while the buffer is rebuilt, then 2 x its generation.
+  uint32_t generation;                        // Number of publishes up to and including this one.
+  Config config;
+  Thermistor thermistor;                      // Initialized from the config's Steinhart-Hart parameters.
+  ControlParameters control;                  // Thresholds for 'getCollectorTransition()'.
+  SafetyThresholds safety;                    // 'minTOn'/'maxTOn' as ADC codes for 'SafetyCutoff'.
+};
+
+class ConfigStore {
+  private:
+    ConfigSnapshot _snapshots[2];
+    std::atomic<const ConfigSnapshot*> _current;
+    uint32_t _generation = 0;
+
+  public:
+    // Publishes the built-in defaults, so that 'current()' is always valid.
+    ConfigStore() : _current(nullptr) {
+      publish(Config());
+    }
+
+    // The most recently published snapshot.
+    const ConfigSnapshot& current() const {
+      return *_current.load(std::memory_order_acquire);
+    }
+
+    // Returns the sequence number to pass to 'isUnchanged()' after reading from 'snapshot'.
+    static uint32_t beginRead(const ConfigSnapshot& snapshot) {
+      return snapshot.sequence.load(std::memory_order_acquire);
+    }
+
+    // True if the reads from 'snapshot' since 'beginRead()' returned 'sequence' saw a complete
+    // snapshot: it was not being rebuilt at the start, and has not been rebuilt since.
+    static bool isUnchanged(const ConfigSnapshot& snapshot, uint32_t sequence) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return (sequence & 1) == 0 && snapshot.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+    // Builds a snapshot of 'config' in the idle buffer and publishes it.
+    void publish(const Config& config) {
+      ConfigSnapshot& next = _current.load(std::memory_order_relaxed) == &_snapshots[0]
+        ? _snapshots[1]
+        : _snapshots[0];
+
+      // Mark the buffer as being rebuilt (odd) before overwriting it, and as complete (even)
+      // after (see 'isUnchanged()'.)
+      _generation++;
+      next.sequence.store(2 * _generation - 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      next.generation = _generation;
+      next.config = config;
+      next.thermistor.init(
+        config.getFloat(SERIES_RESISTOR),
+        config.getFloat(RESISTANCE_AT_0),
+        config.getFloat(TEMPERATURE_AT_0),
+        config.getFloat(B_COEFFICIENT));
+      next.control.minTOn = config.getFloat(MIN_T_ON);
+      next.control.maxTOn = config.getFloat(MAX_T_ON);
+      next.control.deltaTOn = config.getFloat(DELTA_T_ON);
+      next.control.deltaTOff = config.getFloat(DELTA_T_OFF);
+      next.safety = SafetyCutoff::computeThresholds(next.thermistor, next.control.minTOn, next.control.maxTOn);
+
+      next.sequence.store(2 * _generation, std::memory_order_release);
+      _current.store(&next, std::memory_order_release);
+    }
+};
+
+#endif // __CONFIG_SNAPSHOT_H__
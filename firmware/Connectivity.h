@@ -0,0 +1,162 @@
+#ifndef __CONNECTIVITY_H__
+#define __CONNECTIVITY_H__
+
+/*
+ * Connectivity.h - Non-blocking WiFi/Firebase reconnection state machine.
+ *
+ * 'poll()' is called frequently from 'loop()' with the current time and WiFi link status, and
+ * returns the action (if any) the caller should take.  Firebase health is reported through
+ * 'reportCloudResult()': several consecutive failures while the link is up are treated as a
+ * loss of connectivity, and the WiFi connection is restarted.
+ *
+ * Reconnection attempts back off exponentially (with jitter, so a fleet of devices behind the
+ * same access point does not retry in lock step) and the backoff resets after a successful
+ * Firebase request.  The state machine never blocks, so the control loop keeps running while
+ * we are offline.
+ *
+ * This class does no I/O; 'Network::apply()' carries out the returned actions.  (This also lets
+ * 'tools/connectivity-sim' exercise it on the host.)
+ */
+
+#include <stdint.h>
+
+class Connectivity {
+  public:
+    typedef enum {
+      ONLINE = 0,             // Link up; Firebase presumed reachable.
+      OFFLINE,                // Link (or Firebase) lost; waiting for the next attempt.
+      CONNECTING,             // Attempt in progress; waiting for the link to come up.
+    } State;
+
+    typedef enum {
+      NO_ACTION = 0,
+      CONNECT,                // Start connecting with the saved WiFi credentials.
+      RECONNECT,              // Drop the current connection (if any) and connect again.
+    } Action;
+
+  private:
+    static const uint32_t _initial_backoff_ms     = 1000;
+    static const uint32_t _max_backoff_ms         = 5 * 60 * 1000;
+    static const uint32_t _connect_timeout_ms     = 20 * 1000;    // Give up on an attempt after this long.
+    static const uint8_t  _max_cloud_failures     = 3;            // Consecutive failures before we reconnect.
+
+    State _state = ONLINE;
+    uint32_t _backoff_ms = _initial_backoff_ms;
+    uint32_t _deadline_ms = 0;          // OFFLINE: time of next attempt.  CONNECTING: attempt timeout.
+    uint8_t _cloud_failures = 0;
+    bool _cloud_lost = false;           // True if we went offline because Firebase stopped responding.
+
+    uint32_t _reconnects = 0;           // Number of times we have recovered from being offline.
+    uint32_t _attempts = 0;             // Number of connection attempts started.
+    uint32_t _down_since_ms = 0;
+    uint32_t _downtime_ms = 0;          // Total time spent offline (excluding the current outage.)
+
+    uint32_t _random;                   // xorshift32 state used for jitter.
+
+    // True if 'now' is at or after 'deadline' (robust to 'millis()' wrapping.)
+    static bool hasReached(uint32_t now, uint32_t deadline) {
+      return static_cast<int32_t>(now - deadline) >= 0;
+    }
+
+    uint32_t nextRandom() {
+      _random ^= _random << 13;
+      _random ^= _random >> 17;
+      _random ^= _random << 5;
+      return _random;
+    }
+
+    // Schedules the next attempt after a random delay in [backoff/2, backoff], then doubles the backoff.
+    void scheduleAttempt(uint32_t now) {
+      uint32_t half = _backoff_ms / 2;
+      _deadline_ms = now + half + nextRandom() % (half + 1);
+      _backoff_ms = _backoff_ms >= _max_backoff_ms / 2 ? _max_backoff_ms : _backoff_ms * 2;
+      _state = OFFLINE;
+    }
+
+    void goOffline(uint32_t now) {
+      _down_since_ms = now;
+      _cloud_failures = 0;
+      scheduleAttempt(now);
+    }
+
+    void goOnline(uint32_t now) {
+      _downtime_ms += now - _down_since_ms;
+      _reconnects++;
+      _state = ONLINE;
+    }
+
+  public:
+    // 'seed' must be non-zero and should differ between devices (e.g., the chip ID.)
+    explicit Connectivity(uint32_t seed = 2463534242UL) : _random(seed != 0 ? seed : 1) { }
+
+    // Sets the initial state after 'Network::init()'.
+    void init(uint32_t now, bool linkUp) {
+      if (!linkUp) {
+        goOffline(now);
+      }
+    }
+
+    // Advances the state machine.  Returns the action the caller should take now.
+    Action poll(uint32_t now, bool linkUp) {
+      switch (_state) {
+        case ONLINE:
+          if (!linkUp) {
+            _cloud_lost = false;
+            goOffline(now);
+          } else if (_cloud_failures >= _max_cloud_failures) {
+            _cloud_lost = true;
+            goOffline(now);
+          }
+          return NO_ACTION;
+
+        case OFFLINE:
+          if (linkUp && !_cloud_lost) {
+            goOnline(now);      // The SDK reconnected on its own.
+            return NO_ACTION;
+          }
+          if (!hasReached(now, _deadline_ms)) {
+            return NO_ACTION;
+          }
+          _state = CONNECTING;
+          _deadline_ms = now + _connect_timeout_ms;
+          _attempts++;
+          return _cloud_lost ? RECONNECT : CONNECT;
+
+        case CONNECTING:
+          if (linkUp) {
+            _cloud_lost = false;
+            goOnline(now);
+          } else if (hasReached(now, _deadline_ms)) {
+            scheduleAttempt(now);
+          }
+          return NO_ACTION;
+      }
+
+      return NO_ACTION;
+    }
+
+    // Reports the outcome of a Firebase request.
+    void reportCloudResult(bool success) {
+      if (success) {
+        _cloud_failures = 0;
+        _backoff_ms = _initial_backoff_ms;
+      } else if (_cloud_failures < 255) {
+        _cloud_failures++;
+      }
+    }
+
+    // True if cloud requests are worth attempting.
+    bool isOnline() const               { return _state == ONLINE; }
+    State getState() const              { return _state; }
+    uint32_t getReconnects() const      { return _reconnects; }
+    uint32_t getAttempts() const        { return _attempts; }
+
+    // Total time spent offline, including the current outage (if any.)
+    uint32_t getDowntimeMs(uint32_t now) const {
+      return _state == ONLINE
+        ? _downtime_ms
+        : _downtime_ms + (now - _down_since_ms);
+    }
+};
+
+#endif // __CONNECTIVITY_H__
@@ -0,0 +1,66 @@
+#ifndef __CONTROLLER_H__
+#define __CONTROLLER_H__
+
+/*
+ * Controller.h - The decision to engage/disengage the solar collector.
+ *
+ * Kept free of I/O (and of 'CloudStorage') so that host tools (e.g., 'tools/replay') run the
+ * exact logic that runs on the device.  'getShouldEngageCollector()' in firmware.ino supplies
+ * the parameters from the cloud config and logs the outcome.
+ */
+
+typedef enum {
+  NONE = 0,
+  ENGAGE,
+  DISENGAGE,
+} CollectorTransition;
+
+// Which rule produced a 'CollectorTransition' (used for logging.)
+typedef enum {
+  BELOW_MIN_T = 0,          // Pool or collector below 'minTOn'.
+  ABOVE_MAX_T,              // Pool above 'maxTOn'.
+  DELTA_ABOVE_ON,           // Collector warmer than the pool by more than 'deltaTOn'.
+  DELTA_BELOW_OFF,          // Collector warmer than the pool by less than 'deltaTOff'.
+  DELTA_BETWEEN,            // Delta between 'deltaTOff' and 'deltaTOn' (hysteresis band).
+} CollectorReason;
+
+// Thresholds (in Celsius) used by 'getCollectorTransition()'.  See 'Config.h' for details.
+typedef struct {
+  double minTOn;
+  double maxTOn;
+  double deltaTOn;
+  double deltaTOff;
+} ControlParameters;
+
+// Returns ENGAGE if the collector should be engaged, DISENGAGE if it should be disengaged,
+// NONE if it should be left in its current state. 't0' is the temperature of the pool.
+// 't1' is the temperature of the collector.
+inline CollectorTransition getCollectorTransition(const ControlParameters& params, double t0, double t1, CollectorReason& reason) {
+  // If either the pool or the collector are below our minimum temperature, do
+  // not engage the collector.
+  if (t0 < params.minTOn || t1 < params.minTOn) {
+    reason = BELOW_MIN_T;
+    return CollectorTransition::DISENGAGE;
+  }
+
+  if (t0 > params.maxTOn) {
+    reason = ABOVE_MAX_T;
+    return CollectorTransition::DISENGAGE;
+  }
+
+  // If the delta between the pool and collector is large, engage the collector.
+  // If the delta is small or negative, ensure the collector is not engaged.
+  double delta = t1 - t0;
+  if (delta > params.deltaTOn) {
+    reason = DELTA_ABOVE_ON;
+    return CollectorTransition::ENGAGE;
+  } else if (delta < params.deltaTOff) {
+    reason = DELTA_BELOW_OFF;
+    return CollectorTransition::DISENGAGE;
+  } else {
+    reason = DELTA_BETWEEN;
+    return CollectorTransition::NONE;
+  }
+}
+
+#endif // __CONTROLLER_H__
@@ -20,15 +20,20 @@
   return newState;
 }
 
-// Selects the mux input specified by 'channel'.  This mux output connects to the
-// A0 analog pin of the ESP8266.
-void Device::selectAdc(int channel) const {
+// Switches the mux to the input specified by 'channel' without waiting for it to settle.
+void Device::setMux(int channel) const {
   assert(0 <= channel && channel <= 1);
 
   digitalToBool(digitalRead(0));
 
   bool s0_active = (channel & 0x01) != 0;
   digitalWrite(_thermistor_mux_s0_pin, boolToDigital(s0_active));
+}
+
+// Selects the mux input specified by 'channel'.  This mux output connects to the
+// A0 analog pin of the ESP8266.
+void Device::selectAdc(int channel) const {
+  setMux(channel);
 
   // 74HC4051 rise/fall rate max 139ns/V @ 4.5v Vcc
   delay(1);
@@ -71,6 +76,14 @@ int Device::readAdc(int channel) const {
   return analogRead(_thermistor_adc_pin);
 }
 
+// Like 'readAdc()', but busy waits for the mux to settle rather than calling 'delay()', which
+// must not be called from a 'Ticker' callback (see 'SafetyWatch.h'.)
+int Device::readAdcFromTimer(int channel) const {
+  setMux(channel);
+  delayMicroseconds(_mux_settle_us);
+  return analogRead(_thermistor_adc_pin);
+}
+
 // Sets the device to its inital state (relay open, LED on, MUX channel 0).
 void Device::init() {
   pinMode(_relay_pin, OUTPUT);
@@ -21,12 +21,16 @@ class Device {
     // in the low-side relay driver.
     static const uint32_t _relay_pin = 4;                // D2
 
+    // Time allowed for the mux output to settle in 'readAdcFromTimer()'.
+    static const uint32_t _mux_settle_us = 50;
+
   public:
     void setRelay(bool closed) const;
     bool getRelay() const;
     void setLed(bool on);
     void blinkLed(uint32_t rateInMilliseconds);
     int readAdc(int channel) const;
+    int readAdcFromTimer(int channel) const;
     void init();
 
   private:
@@ -35,6 +39,7 @@ class Device {
     static bool negateDigital(uint32_t pin);
     static bool toggleLed();
     void selectAdc(int channel) const;
+    void setMux(int channel) const;
 
     Ticker _led_ticker;
 };
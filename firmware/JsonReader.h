@@ -0,0 +1,305 @@
+#ifndef __JSON_READER_H__
+#define __JSON_READER_H__
+
+/*
+ * JsonReader.h - A streaming (pull) JSON tokenizer that uses a fixed amount of memory.
+ *
+ * Reads one token at a time from a 'Source' (any class with an 'int read()' method that returns
+ * the next byte, or -1 at the end of input).  Unlike 'FirebaseObject'/'JsonVariant', nothing is
+ * materialized: the text of the current key/string/number is held in a fixed size scratch buffer
+ * and is overwritten by the next call to 'next()'.  Text longer than the scratch buffer is
+ * truncated (see 'isTruncated()').
+ *
+ * Typical use:
+ *
+ *    JsonReader<MySource> reader(source);
+ *    if (reader.next() != JSON_BEGIN_OBJECT) { ...error... }
+ *    while (reader.next() == JSON_KEY) {
+ *      ...inspect 'reader.text()', then consume the value with 'next()' or 'skipValue()'...
+ *    }
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  JSON_BEGIN_OBJECT = 0,
+  JSON_END_OBJECT,
+  JSON_BEGIN_ARRAY,
+  JSON_END_ARRAY,
+  JSON_KEY,                 // An object member's name.  ('text()' holds the unquoted name.)
+  JSON_STRING,              // 'text()' holds the unquoted/unescaped value.
+  JSON_NUMBER,              // 'text()' holds the number as it appeared in the input.
+  JSON_TRUE,
+  JSON_FALSE,
+  JSON_NULL,
+  JSON_END,                 // End of input.
+  JSON_ERROR,               // Malformed input or nesting deeper than '_max_depth'.
+} JsonToken;
+
+template <typename Source, size_t TextSize = 64>
+class JsonReader {
+  public:
+    static const uint8_t _max_depth = 32;
+
+  private:
+    Source& _source;
+    int _peeked = -2;               // Lookahead character (-2 if none.)
+
+    char _text[TextSize];           // Text of the current token.
+    size_t _length = 0;
+    bool _truncated = false;
+
+    uint32_t _in_object = 0;        // Bit 'n' is set if the container at depth 'n + 1' is an object.
+    uint8_t _depth = 0;
+    char _delimiter = '\0';         // The last structural character consumed ('{', '[', ',' or ':').
+
+    int peek() {
+      if (_peeked == -2) {
+        _peeked = _source.read();
+      }
+      return _peeked;
+    }
+
+    int read() {
+      int ch = peek();
+      _peeked = -2;
+      return ch;
+    }
+
+    void append(char ch) {
+      if (_length < TextSize - 1) {
+        _text[_length++] = ch;
+      } else {
+        _truncated = true;
+      }
+    }
+
+    void clearText() {
+      _length = 0;
+      _truncated = false;
+    }
+
+    bool isInObject() const {
+      return _depth > 0 && (_in_object & (1UL << (_depth - 1))) != 0;
+    }
+
+    JsonToken push(bool isObject, JsonToken token) {
+      if (_depth >= _max_depth) {
+        return JSON_ERROR;
+      }
+
+      if (isObject) {
+        _in_object |= 1UL << _depth;
+      } else {
+        _in_object &= ~(1UL << _depth);
+      }
+      _depth++;
+      return token;
+    }
+
+    JsonToken pop(bool isObject, JsonToken token) {
+      if (_depth == 0 || isInObject() != isObject) {
+        return JSON_ERROR;
+      }
+      _depth--;
+      return token;
+    }
+
+    static int hexValue(int ch) {
+      if ('0' <= ch && ch <= '9') { return ch - '0'; }
+      if ('a' <= ch && ch <= 'f') { return ch - 'a' + 10; }
+      if ('A' <= ch && ch <= 'F') { return ch - 'A' + 10; }
+      return -1;
+    }
+
+    // Appends the UTF-8 encoding of the '\uXXXX' escape that follows the current position.
+    // (Surrogate pairs are passed through as two separately encoded code units.)
+    bool readUnicodeEscape() {
+      uint32_t codePoint = 0;
+      for (int i = 0; i < 4; i++) {
+        int digit = hexValue(read());
+        if (digit < 0) {
+          return false;
+        }
+        codePoint = (codePoint << 4) | digit;
+      }
+
+      if (codePoint < 0x80) {
+        append(static_cast<char>(codePoint));
+      } else if (codePoint < 0x800) {
+        append(static_cast<char>(0xC0 | (codePoint >> 6)));
+        append(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      } else {
+        append(static_cast<char>(0xE0 | (codePoint >> 12)));
+        append(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        append(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+      return true;
+    }
+
+    // Reads a string into '_text'.  The opening quote has already been consumed.
+    bool readString() {
+      for (;;) {
+        int ch = read();
+        switch (ch) {
+          case -1:
+            return false;
+          case '"':
+            return true;
+          case '\\':
+            ch = read();
+            switch (ch) {
+              case 'b': append('\b'); break;
+              case 'f': append('\f'); break;
+              case 'n': append('\n'); break;
+              case 'r': append('\r'); break;
+              case 't': append('\t'); break;
+              case 'u':
+                if (!readUnicodeEscape()) {
+                  return false;
+                }
+                break;
+              case '"': case '\\': case '/':
+                append(static_cast<char>(ch));
+                break;
+              default:
+                return false;
+            }
+            break;
+          default:
+            append(static_cast<char>(ch));
+            break;
+        }
+      }
+    }
+
+    // Reads the remainder of a number or literal (true/false/null) into '_text'.
+    void readWord() {
+      for (;;) {
+        int ch = peek();
+        bool isWordChar = ('0' <= ch && ch <= '9') || ('a' <= ch && ch <= 'z')
+          || ch == '-' || ch == '+' || ch == '.' || ch == 'E';
+        if (!isWordChar) {
+          return;
+        }
+        append(static_cast<char>(read()));
+      }
+    }
+
+    bool textEquals(const char* literal) const {
+      return !_truncated && strcmp(_text, literal) == 0;
+    }
+
+  public:
+    JsonReader(Source& source) : _source(source) {
+      _text[0] = '\0';
+    }
+
+    // Consumes and returns the next token.
+    JsonToken next() {
+      clearText();
+
+      int ch;
+      for (;;) {
+        ch = read();
+        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+          continue;
+        }
+        if (ch == ',' || ch == ':') {
+          _delimiter = static_cast<char>(ch);
+          continue;
+        }
+        break;
+      }
+
+      JsonToken token;
+      switch (ch) {
+        case -1:
+          token = _depth == 0 ? JSON_END : JSON_ERROR;
+          break;
+        case '{':
+          token = push(/* isObject = */ true, JSON_BEGIN_OBJECT);
+          _delimiter = '{';
+          break;
+        case '[':
+          token = push(/* isObject = */ false, JSON_BEGIN_ARRAY);
+          _delimiter = '[';
+          break;
+        case '}':
+          token = pop(/* isObject = */ true, JSON_END_OBJECT);
+          break;
+        case ']':
+          token = pop(/* isObject = */ false, JSON_END_ARRAY);
+          break;
+        case '"': {
+          // Inside an object, a string that follows '{' or ',' is a member name.
+          bool isKey = isInObject() && (_delimiter == '{' || _delimiter == ',');
+          token = readString()
+            ? (isKey ? JSON_KEY : JSON_STRING)
+            : JSON_ERROR;
+          break;
+        }
+        default:
+          append(static_cast<char>(ch));
+          readWord();
+          _text[_length] = '\0';     // Terminate before comparing against literals.
+
+          if ((ch == '-') || ('0' <= ch && ch <= '9')) {
+            token = JSON_NUMBER;
+          } else if (textEquals("true")) {
+            token = JSON_TRUE;
+          } else if (textEquals("false")) {
+            token = JSON_FALSE;
+          } else if (textEquals("null")) {
+            token = JSON_NULL;
+          } else {
+            token = JSON_ERROR;
+          }
+          break;
+      }
+
+      _text[_length] = '\0';
+
+      // Anything other than a member name or an opening brace/bracket completes a value.
+      if (token != JSON_KEY && token != JSON_BEGIN_OBJECT && token != JSON_BEGIN_ARRAY) {
+        _delimiter = '\0';
+      }
+      return token;
+    }
+
+    // Consumes the remainder of a value whose first token was 'token' (i.e., if 'token' opened
+    // an object or array, consumes everything through the matching close.)  Returns false on
+    // malformed input.
+    bool skipValue(JsonToken token) {
+      if (token == JSON_ERROR || token == JSON_END || token == JSON_KEY
+        || token == JSON_END_OBJECT || token == JSON_END_ARRAY) {
+        return false;
+      }
+
+      if (token != JSON_BEGIN_OBJECT && token != JSON_BEGIN_ARRAY) {
+        return true;
+      }
+
+      uint8_t depth = _depth;
+      while (_depth >= depth) {
+        token = next();
+        if (token == JSON_ERROR || token == JSON_END) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Text of the most recent key, string or number token (or the scalar literal.)
+    const char* text() const      { return _text; }
+
+    // True if the text of the most recent token did not fit in the scratch buffer.
+    bool isTruncated() const      { return _truncated; }
+
+    // Number of currently open objects/arrays.
+    uint8_t depth() const         { return _depth; }
+};
+
+#endif // __JSON_READER_H__
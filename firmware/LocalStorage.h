@@ -6,6 +6,10 @@
  * 
  * Configuration is loaded from SPIFFS during init() from the file '/config.txt'.  '/config.txt'
  * is a binary file containing 4 null terimnated strings.
+ *
+ * The last config successfully loaded from Firebase is also kept in '/cloud-config.txt' (one
+ * 'key=value' line per setting; see 'Config::saveTo()'), so that the device can boot with it
+ * while offline.
  * 
  * Note: You can reset previously saved configuration by pressing the RESET button during
  *       boot while the built-in LED is rapidly flashing (i.e., press RESET, wait for rapid
@@ -14,6 +18,7 @@
 
 #include <assert.h>
 #include "FS.h"
+#include "Config.h"
 #include "Device.h"
 #include "Secrets.h"
 
@@ -27,6 +32,8 @@ class LocalStorage {
     bool _isConfigLoaded = false;   // True if '/config.txt' was successfully loaded during 'init()'.
   
     const char* const _config_file_name = "/config.txt";
+    const char* const _cloud_config_file_name = "/cloud-config.txt";
+    const char* const _cloud_config_temp_file_name = "/cloud-config.tmp";
     const char* const _reset_sentinel_file_name = "/reset-config.txt";
     const char* const _for_write = "w";
     const char* const _for_read = "r";
@@ -45,7 +52,7 @@ class LocalStorage {
             : "Creating '"
           : "Opening '");
       
-      Serial.print(_config_file_name); Serial.print("' for '"); Serial.print(mode); Serial.print("': ");
+      Serial.print(fileName); Serial.print("' for '"); Serial.print(mode); Serial.print("': ");
 
       // Open the file and log success/failure.
       File file = SPIFFS.open(fileName, mode);
@@ -82,6 +89,33 @@ class LocalStorage {
       file.print('\0');   // 'file.print()' does not include the null-terminator, so we do so.
     }
 
+    // Loads a copy of the cloud config saved in 'fileName' into 'config' if it is complete and
+    // valid (see 'Config::loadFrom()'.)  Otherwise leaves 'config' unmodified and returns false.
+    bool loadCloudConfigFile(const char* const fileName, Config& config, uint8_t& changed) {
+      if (!SPIFFS.exists(fileName)) {
+        return false;
+      }
+
+      Serial.print("  ");
+      File file = openFile(fileName, _for_read);
+      if (!file) {
+        return false;
+      }
+
+      Config loaded = config;
+      uint8_t loadedChanges = 0;
+      bool success = loaded.loadFrom(file, loadedChanges);
+      file.close();
+      if (!success) {
+        Serial.println("  [INVALID]");
+        return false;
+      }
+
+      config = loaded;
+      changed |= loadedChanges;
+      return true;
+    }
+
     // Initializes this class's member variables with the values saved in '/config.txt'.
     bool loadConfig() {
       // TODO(mikelehen): Reenable loading / saving from device.
@@ -132,6 +166,49 @@ class LocalStorage {
       SPIFFS.remove(_reset_sentinel_file_name);
     }
 
+    // Saves 'config' as the last good cloud config.  It is written to a temporary file first and
+    // then renamed over the previous copy.  (SPIFFS can't rename over an existing file, so the
+    // previous copy is removed first.  A reset before the rename leaves the complete temporary
+    // file, which 'loadCloudConfig()' falls back to.)
+    bool saveCloudConfig(const Config& config) {
+      Serial.print("Saving cloud configuration: ");
+      File file = openFile(_cloud_config_temp_file_name, _for_write);
+      if (!file) {
+        return false;
+      }
+
+      config.saveTo(file);
+      file.close();
+
+      SPIFFS.remove(_cloud_config_file_name);
+      if (!SPIFFS.rename(_cloud_config_temp_file_name, _cloud_config_file_name)) {
+        Serial.println("  Renaming: [FAILED]");
+        return false;
+      }
+      return true;
+    }
+
+    // Loads the config saved by 'saveCloudConfig()' into 'config', ORing the subsystems of the
+    // settings that changed into 'changed'.  If the saved copy is missing or invalid, falls back
+    // to a complete temporary copy left by a save that was interrupted before its rename.
+    // Returns false (leaving 'config' unmodified) if neither is valid.
+    bool loadCloudConfig(Config& config, uint8_t& changed) {
+      Serial.println("Loading saved cloud configuration: ");
+      if (loadCloudConfigFile(_cloud_config_file_name, config, changed)) {
+        return true;
+      }
+
+      if (!loadCloudConfigFile(_cloud_config_temp_file_name, config, changed)) {
+        Serial.println("  (None saved.)");
+        return false;
+      }
+
+      // Finish the interrupted save.
+      SPIFFS.remove(_cloud_config_file_name);
+      SPIFFS.rename(_cloud_config_temp_file_name, _cloud_config_file_name);
+      return true;
+    }
+
     void init(Device& device) {
       Serial.print("Mounting SPIFFS file system (be patient if formatting a new device): ");
       if (!SPIFFS.begin()) {
@@ -142,8 +219,10 @@ class LocalStorage {
 
       // If the sentinel file exists, the user has requested that we delete our saved configuration.
       if (SPIFFS.exists(_reset_sentinel_file_name)) {
-        // Remove '/config.txt', if it exists.
+        // Remove '/config.txt' and the saved cloud config, if they exist.
         SPIFFS.remove(_config_file_name);
+        SPIFFS.remove(_cloud_config_file_name);
+        SPIFFS.remove(_cloud_config_temp_file_name);
         Serial.println();
         Serial.println("*** Note: Local configuration has been cleared.");
       } else {
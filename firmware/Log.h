@@ -20,11 +20,11 @@ class Log {
   private:
     Level _cloudLevel;
     Level _serialLevel;
-    CloudStorage _cloud;
+    CloudStorage& _cloud;           // Shared with 'loop()' (we do not own a second copy of the config.)
   
   public:
 
-    Log() {
+    Log(CloudStorage& cloud) : _cloud(cloud) {
       _cloudLevel = Level::INFO;
       _serialLevel = Level::INFO;
     }
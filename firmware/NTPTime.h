@@ -4,7 +4,8 @@
 /*
  * NTPTime.h - Synchronize Arduino 'Time' library with an NTP server.
  * 
- * Uses the NTP functionality from the Esp8266 SDK.
+ * Uses the NTP functionality from the Esp8266 SDK.  (See 'Clock.h' for the millisecond clock
+ * used to timestamp samples.)
  */
 
 #include <Time.h>
@@ -42,7 +43,10 @@ class NTPTime {
     }
     
   public:
+    // May be called again to apply a new server/offset.
     void init(const char* const ntpServer, int8_t gmtOffset) {
+      sntp_stop();
+
       // Set the NTP server.
       Serial.print("Syncronizing clock with NTP server '"); Serial.print(ntpServer); Serial.println("': ");
       sntp_setservername(0, const_cast<char*>(ntpServer));
@@ -60,24 +64,21 @@ class NTPTime {
         // the NTP server.
         if (timestamp > 0) {
           Serial.print("  Clock synchronized to: "); Serial.print(sntp_get_real_time(timestamp));
+
+          // Relax the sync interval to once every 30 minutes once we have our first timestamp.
+          setSyncInterval(30 * 60);
         }
 
         // Return 'timestamp' to the 'Time' library as the new current time.
         return static_cast<time_t>(timestamp);
       });
 
-      // Initialize 'sntp' and beginning polling at a frequency of 1 second for our initial
-      // timestamp.
+      // Initialize 'sntp' and poll at a frequency of 1 second for our initial timestamp.
+      //
+      // Note: We do not wait for the first response from the NTP server.  Sample timestamps
+      //       come from 'Clock', which becomes valid on its own once the response arrives.
       sntp_init();
       setSyncInterval(1);
-
-      // Block until we've recieved our first response from the NTP server.
-      do {
-        delay(100);
-      } while((timeStatus() == timeNotSet));
-
-      // Relax the sync interval to once every 30 minutes.
-      setSyncInterval(30 * 60);
     }
 };
 
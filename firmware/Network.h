@@ -11,6 +11,9 @@
  * The captive portal is used to configure both WiFi and Firebase, since the device needs
  * both to connect to the cloud and retrieve its remaining configuration.
  * 
+ * If the saved network is unavailable, 'init()' returns without a connection rather than
+ * restarting the device.  'Connectivity' then reconnects in the background (see 'apply()').
+ *
  * Note: You can force the captive portal to reconfigure by pressing the RESET button
  *       during boot to delete the locally stored settings.  (See note in LocalStorage.h.)
  */
@@ -20,6 +23,7 @@
 #include <user_interface.h>
 #include "LocalStorage.h"
 #include "CloudStorage.h"
+#include "Connectivity.h"
 
 // Used within init() to detect if 'WiFiManager::setSaveConfigCallback()' lambda was invoked.
 static bool _shouldSave;
@@ -70,13 +74,12 @@ class Network {
         // Have 'WiFiManager' wait for a successful connection.  If the connection fails,
         // 'WiFiManager' will automatically start the captive portal using the SSID specified
         // below. But we don't want to wait forever for the captive portal, so we give you 2
-        // minutes to use it and then we restart and try from scratch.
+        // minutes to use it and then continue offline.  ('Connectivity' keeps retrying in the
+        // background while the control loop runs.)
         wifiManager.setConfigPortalTimeout(120);
         if (!wifiManager.autoConnect(configPortalSSID.c_str())) {
-          Serial.println("Failed to connect. Resetting.");
-          delay(3000);
-          ESP.restart();
-          delay(5000);
+          Serial.println("Failed to connect. Continuing offline.");
+          WiFi.begin(wifiSsid, wifiPassword);
         }
       } else {
         // There were no settings saved in local storage, go directly to the captive portal.
@@ -106,16 +109,35 @@ class Network {
         _shouldSave = false;
       }
 
-      // Paranoid busy loop to await the WiFi connection.  
+      // Report the WiFi connection (if any.)
       Serial.println(); Serial.println(); Serial.print("Connecting to WiFi: ");
-      while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
+      if (WiFi.status() == WL_CONNECTED) {
+        Serial.println(WiFi.localIP());
+      } else {
+        Serial.println("[OFFLINE]");
       }
-      Serial.println(WiFi.localIP());
 
       // Stop blinking the built-in LED.
       device.setLed(true);
     }
+
+    // Carries out an action requested by 'Connectivity::poll()'.  Does not wait for the
+    // connection to complete.
+    static void apply(Connectivity::Action action) {
+      switch (action) {
+        case Connectivity::NO_ACTION:
+          break;
+        case Connectivity::CONNECT:
+          Serial.println("Reconnecting to WiFi.");
+          WiFi.begin();         // Uses the credentials saved by the SDK during 'init()'.
+          break;
+        case Connectivity::RECONNECT:
+          Serial.println("Firebase unreachable.  Restarting WiFi connection.");
+          WiFi.disconnect();
+          WiFi.begin();
+          break;
+      }
+    }
 };
 
 #endif // __NETWORK_H__
@@ -0,0 +1,103 @@
+#ifndef __ROLLING_STATS_H__
+#define __ROLLING_STATS_H__
+
+/*
+ * RollingStats.h - Constant memory trend statistics for one ADC channel.
+ *
+ * Maintains an exponentially weighted mean, variance and least-squares slope (against time) of
+ * the raw samples, updated in O(1) per sample.  Older samples decay with time constant
+ * 'windowSeconds', so the statistics describe roughly the last 'windowSeconds' without storing
+ * any history.
+ *
+ * The updates are the weighted form of Welford's algorithm: the mean and co-moments are updated
+ * from deviations rather than accumulated sums of squares, so they do not lose precision to
+ * cancellation as the (decayed) sample count grows.
+ *
+ * Samples are raw ADC codes (no per-sample Steinhart-Hart.)  'getTrend()' converts the result
+ * to Celsius using the thermistor's slope at the mean, once per polling period.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "Thermistor.h"
+
+// Statistics converted to temperatures (see 'RollingStats::getTrend()'.)
+typedef struct {
+  double celsius;                   // Weighted mean temperature.
+  double noise;                     // Standard deviation about the fitted line (i.e., excluding the trend.)
+  double perHour;                   // Least-squares rate of change in Celsius per hour.
+} Trend;
+
+class RollingStats {
+  private:
+    bool _has_samples = false;
+    uint32_t _last_ms;              // 'millis()' of the previous sample.
+    double _t = 0;                  // Seconds since the first sample.
+
+    double _weight = 0;             // Sum of the (decayed) sample weights.
+    double _mean = 0;               // Weighted mean of the samples.
+    double _mean_t = 0;             // Weighted mean of the sample times.
+    double _m2 = 0;                 // Weighted sum of squared deviations of the samples...
+    double _m2_t = 0;               // ...of the sample times...
+    double _c_tx = 0;               // ...and the co-moment of times and samples.
+
+  public:
+    // Adds a sample taken at 'now' (from 'millis()'.)
+    void add(uint32_t now, double x, double windowSeconds) {
+      double decay = 1;
+      if (_has_samples) {
+        double elapsed = (now - _last_ms) / 1000.0;   // Unsigned subtraction handles 'millis()' wrapping.
+        _t += elapsed;
+        decay = exp(-elapsed / windowSeconds);
+      }
+      _has_samples = true;
+      _last_ms = now;
+
+      _weight = _weight * decay + 1;
+      double dx = x - _mean;
+      double dt = _t - _mean_t;
+      _mean += dx / _weight;
+      _mean_t += dt / _weight;
+
+      // Each co-moment pairs the deviation from the old mean with the deviation from the new.
+      _m2   = _m2   * decay + dx * (x - _mean);
+      _m2_t = _m2_t * decay + dt * (_t - _mean_t);
+      _c_tx = _c_tx * decay + dt * (x - _mean);
+    }
+
+    double getMean() const {
+      return _mean;
+    }
+
+    double getVariance() const {
+      return _weight > 0 ? _m2 / _weight : 0;
+    }
+
+    // Least-squares slope in ADC codes per second (0 until there are two samples.)
+    double getSlope() const {
+      return _m2_t > 0 ? _c_tx / _m2_t : 0;
+    }
+
+    // Variance of the samples about the least-squares line (i.e., the noise, excluding the trend.)
+    double getResidualVariance() const {
+      if (_weight <= 0) {
+        return 0;
+      }
+      double residual = _m2_t > 0 ? _m2 - _c_tx * _c_tx / _m2_t : _m2;
+      return residual > 0 ? residual / _weight : 0;
+    }
+
+    // Converts the statistics to Celsius.  The thermistor is non-linear, so deviations are scaled
+    // by its slope at the mean (accurate while the window spans a few degrees.)
+    Trend getTrend(const Thermistor& thermistor) const {
+      double at = fmin(fmax(_mean, 1.0), 1022.0);     // Keep 'at +/- 0.5' within the ADC's range.
+      double celsiusPerCode = thermistor.toReading(at + 0.5)._celsius - thermistor.toReading(at - 0.5)._celsius;
+      Trend trend;
+      trend.celsius = thermistor.toReading(_mean)._celsius;
+      trend.noise = sqrt(getResidualVariance()) * fabs(celsiusPerCode);
+      trend.perHour = getSlope() * celsiusPerCode * 3600;
+      return trend;
+    }
+};
+
+#endif // __ROLLING_STATS_H__
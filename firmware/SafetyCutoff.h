@@ -0,0 +1,105 @@
+#ifndef __SAFETY_CUTOFF_H__
+#define __SAFETY_CUTOFF_H__
+
+/*
+ * SafetyCutoff.h - Per-sample over/under temperature check that does not wait for the
+ * 'oversample' averaging period.
+ *
+ * 'computeThresholds()' converts 'minTOn' and 'maxTOn' to ADC codes once per config change
+ * (see 'ConfigSnapshot.h'), so checking a raw sample is an integer compare rather than a
+ * Steinhart-Hart evaluation.  The thermistors are NTC (hotter
+ * reads as a lower ADC code.)  As in 'getCollectorTransition()', 'maxTOn' applies to the pool
+ * (channel 0) and 'minTOn' applies to either channel.
+ *
+ * A channel trips once '_required' of its last '_window' samples are out of range, so a single
+ * noisy sample does not open the relay.  Trips are held (one per channel) for 'takeEvent()' so
+ * that the caller can log them once the sampling period is over, rather than from the sample
+ * path.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "Controller.h"
+#include "Thermistor.h"
+
+// 'minTOn' and 'maxTOn' as ADC codes (see 'SafetyCutoff::computeThresholds()'.)
+typedef struct {
+  int32_t hotBelow;                           // Pool samples below this code are above 'maxTOn'.
+  int32_t coldAbove;                          // Samples above this code are below 'minTOn'.
+} SafetyThresholds;
+
+class SafetyCutoff {
+  public:
+    static const uint8_t _window = 3;         // Samples per channel considered for a trip (M).
+    static const uint8_t _required = 2;       // Out of range samples within the window that trip (N).
+
+    typedef struct {
+      CollectorReason reason;                 // BELOW_MIN_T or ABOVE_MAX_T.
+      uint8_t channel;
+      int32_t adc;                            // The sample that tripped the cutoff.
+    } Event;
+
+  private:
+    uint8_t _history[2] = {};                 // Bit i is set if the channel's i'th most recent sample was out of range.
+    bool _tripped[2] = {};
+
+    bool _has_event[2] = {};                  // One pending trip per channel, so both channels
+    Event _events[2];                         // tripping in the same period are both reported.
+
+    static uint8_t countViolations(uint8_t history) {
+      return __builtin_popcount(history & ((1 << _window) - 1));
+    }
+
+  public:
+    // Precomputes the ADC thresholds for the given thermistor and limits.
+    static SafetyThresholds computeThresholds(const Thermistor& thermistor, double minTOn, double maxTOn) {
+      // Samples are integers, so 'adc < x' <=> 'adc < ceil(x)' and 'adc > x' <=> 'adc > floor(x)'.
+      SafetyThresholds thresholds;
+      thresholds.hotBelow = static_cast<int32_t>(ceil(thermistor.celsiusToAdc(maxTOn)));
+      thresholds.coldAbove = static_cast<int32_t>(floor(thermistor.celsiusToAdc(minTOn)));
+      return thresholds;
+    }
+
+    // Checks a raw sample from 'channel' (0 = pool, 1 = collector.)  Returns true while the
+    // channel is tripped, in which case the collector must be disengaged.
+    bool check(const SafetyThresholds& thresholds, uint8_t channel, int32_t adc) {
+      CollectorReason reason = BELOW_MIN_T;
+      bool violation = adc > thresholds.coldAbove;
+      if (channel == 0 && adc < thresholds.hotBelow) {
+        reason = ABOVE_MAX_T;
+        violation = true;
+      }
+
+      _history[channel] = (_history[channel] << 1) | (violation ? 1 : 0);
+      bool tripped = countViolations(_history[channel]) >= _required;
+
+      // If the channel trips again before the event is taken, keep the first trip.
+      if (tripped && !_tripped[channel] && !_has_event[channel]) {
+        _events[channel].reason = reason;
+        _events[channel].channel = channel;
+        _events[channel].adc = adc;
+        _has_event[channel] = true;
+      }
+      _tripped[channel] = tripped;
+      return tripped;
+    }
+
+    // True while either channel is tripped.
+    bool isTripped() const {
+      return _tripped[0] || _tripped[1];
+    }
+
+    // Returns a trip not yet taken (if any), pool first.  Call until it returns false.
+    bool takeEvent(Event& event) {
+      for (uint8_t channel = 0; channel < 2; channel++) {
+        if (_has_event[channel]) {
+          event = _events[channel];
+          _has_event[channel] = false;
+          return true;
+        }
+      }
+      return false;
+    }
+};
+
+#endif // __SAFETY_CUTOFF_H__
@@ -0,0 +1,55 @@
+#ifndef __SAFETY_WATCH_H__
+#define __SAFETY_WATCH_H__
+
+/*
+ * SafetyWatch.h - Keeps running the 'SafetyCutoff' checks from a 'Ticker' while 'loop()' is
+ * blocked between sampling periods (logging to Firebase, or loading config), which can take
+ * several seconds per attempt.  Without it, a trip during that time would not open the relay
+ * until the blocking call returned.
+ *
+ * 'Ticker' callbacks run whenever the blocked code yields (e.g., while the HTTP client waits on
+ * the network or in 'delay()'), so code that runs for a long time without yielding (e.g., a TLS
+ * handshake) still delays the check.  The watch is only armed outside of the sampling loop, so
+ * its samples never interleave with 'loop()'s use of the mux.
+ */
+
+#include <Ticker.h>
+#include "Device.h"
+#include "SafetyCutoff.h"
+
+class SafetyWatch {
+  private:
+    Device& _device;
+    SafetyCutoff& _safety;
+    SafetyThresholds _thresholds;
+    Ticker _ticker;
+
+    static void tick(SafetyWatch* watch) {
+      watch->check();
+    }
+
+    // Samples both channels once, opening the relay if either channel is tripped.
+    void check() {
+      for (uint8_t channel = 0; channel < 2; channel++) {
+        if (_safety.check(_thresholds, channel, _device.readAdcFromTimer(channel)) && _device.getRelay()) {
+          _device.setRelay(false);
+        }
+      }
+    }
+
+  public:
+    SafetyWatch(Device& device, SafetyCutoff& safety)
+      : _device(device), _safety(safety) { }
+
+    // Checks both channels against 'thresholds' every 'intervalMs' until 'disarm()' is called.
+    void arm(const SafetyThresholds& thresholds, uint32_t intervalMs) {
+      _thresholds = thresholds;
+      _ticker.attach_ms(intervalMs > 0 ? intervalMs : 1, tick, this);
+    }
+
+    void disarm() {
+      _ticker.detach();
+    }
+};
+
+#endif // __SAFETY_WATCH_H__
@@ -29,12 +29,12 @@ class Thermistor {
     double _b;                                // 'B' coefficient in Steinhart-Hart equation
 
     // Convert ADC [0..1023] voltage reading to thermistor resistance
-    double adcToResistance(double adc) {
+    double adcToResistance(double adc) const {
       return _rs / ((1023.0 / adc) - 1.0);    // Solve for thermistor resistance in voltage divider.
     }
 
     // Calculates temperature in Celsius from thermistor resistance.
-    double resistanceToCelsius(double r) {
+    double resistanceToCelsius(double r) const {
       double steinhart;
       
       steinhart = r / _r0;                    // (R/R0)
@@ -57,11 +57,18 @@ class Thermistor {
     }
 
     // Map raw ADC reading to thermistor resistance (in Ohms) and temperature (in Celsius).
-    ThermistorReading toReading(double adc) {
+    ThermistorReading toReading(double adc) const {
       double resistance = adcToResistance(adc);
       double celsius = resistanceToCelsius(resistance);
       return ThermistorReading(adc, resistance, celsius);
     }
+
+    // Inverse of 'toReading()': the ADC reading [0..1023] at which the thermistor is at the
+    // given temperature (in Celsius).  Used to precompute thresholds (see 'SafetyCutoff.h'.)
+    double celsiusToAdc(double celsius) const {
+      double r = _r0 * exp(_b * (1.0 / (celsius + _k) - 1.0 / _t0));    // Steinhart-Hart solved for R.
+      return 1023.0 * r / (r + _rs);                                      // Voltage divider solved for ADC.
+    }
 };
 
 #endif // __THERMISTOR_H__
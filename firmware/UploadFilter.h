@@ -0,0 +1,60 @@
+#ifndef __UPLOAD_FILTER_H__
+#define __UPLOAD_FILTER_H__
+
+/*
+ * UploadFilter.h - Decides which samples are worth logging to the cloud.
+ *
+ * A sample is logged if either channel's ADC average has moved by more than the deadband since
+ * the last logged sample, if the relay has changed state, or if the heartbeat interval has
+ * elapsed.  Otherwise it is counted as skipped.
+ *
+ * Readers reconstruct the series as steps: each logged sample holds until the next one.  Each
+ * record carries the number of samples skipped before it (see 'CloudStorage::log()'), and a gap
+ * longer than the heartbeat means the device was not logging (e.g., offline.)
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+class UploadFilter {
+  private:
+    bool _has_last = false;             // False until the first sample is logged.
+    double _last_adc[2];                // The last logged sample.
+    bool _last_active;
+    uint32_t _last_ms;                  // 'millis()' when the last sample was logged.
+    uint32_t _skipped = 0;              // Samples skipped since the last logged sample.
+
+  public:
+    // Returns true if the sample should be logged.  A 'deadband' of 0 logs every sample.
+    bool shouldUpload(uint32_t now, double adc0, double adc1, bool active, float deadband, uint32_t heartbeatMs) {
+      bool upload = !_has_last
+        || deadband <= 0
+        || active != _last_active
+        || fabs(adc0 - _last_adc[0]) > deadband
+        || fabs(adc1 - _last_adc[1]) > deadband
+        || now - _last_ms >= heartbeatMs;
+
+      if (!upload) {
+        _skipped++;
+      }
+      return upload;
+    }
+
+    // Records that the sample was successfully logged.  (If the upload failed, don't call this,
+    // so that the next sample is compared against the last sample that readers actually have.)
+    void uploaded(uint32_t now, double adc0, double adc1, bool active) {
+      _has_last = true;
+      _last_adc[0] = adc0;
+      _last_adc[1] = adc1;
+      _last_active = active;
+      _last_ms = now;
+      _skipped = 0;
+    }
+
+    // Number of samples skipped since the last logged sample.
+    uint32_t getSkipped() const {
+      return _skipped;
+    }
+};
+
+#endif // __UPLOAD_FILTER_H__
@@ -3,20 +3,32 @@
 #include "LocalStorage.h"
 #include "Network.h"
 #include "CloudStorage.h"
-#include "Thermistor.h"
+#include "ConfigSnapshot.h"
 #include "NTPTime.h"
+#include "Clock.h"
 #include "Log.h"
+#include "Controller.h"
+#include "Connectivity.h"
+#include "UploadFilter.h"
+#include "SafetyCutoff.h"
+#include "SafetyWatch.h"
+#include "RollingStats.h"
 
 Device _device;           // I/O driver for the hardware device (set relay state, set LED state, etc.)
+LocalStorage _localStorage; // WiFi/Firebase settings and the last good cloud config, in flash.
 CloudStorage _cloud;      // Load/store data in the Firebase realtime database.
-Thermistor _thermistor;   // For converting ADC values to temperatures.
-Log _log;
+ConfigStore _configStore; // Published config snapshots (with the thermistor used to convert ADC values.)
+Clock _clock;             // Millisecond wall clock used to timestamp samples.
+Log _log(_cloud);         // Logs to the serial monitor and (eventually) the cloud.
+Connectivity _connectivity(ESP.getChipId());  // Reconnects WiFi/Firebase in the background.
+UploadFilter _uploadFilter;                   // Skips logging samples that haven't changed.
+SafetyCutoff _safety;                         // Opens the relay on out of range raw samples.
+SafetyWatch _safetyWatch(_device, _safety);   // Runs '_safety' while 'loop()' is blocked on Firebase.
+RollingStats _stats[2];                       // Per-channel trend statistics over the raw samples.
 
-typedef enum {
-  NONE = 0,
-  ENGAGE,
-  DISENGAGE,
-} CollectorTransition;
+bool _isConfigLoaded = false;         // True once we have loaded our config from Firebase.
+bool _hasConfig = false;              // True once we have a config from Firebase or flash.  Until then, the relay stays open.
+uint32_t _nextConfigAttemptMs = 0;    // 'millis()' at which to next try loading config (if not loaded.)
 
 void setup() {
   // Use same baudrate as the ESP8266 bootloader, so that boot messages are readable.
@@ -29,110 +41,231 @@ void setup() {
 
   // Load saved Wifi SSID/Password and Firebase auth/host info from built-in flash.
   Serial.println();
-  LocalStorage localStorage;
-  localStorage.init(_device);
+  _localStorage.init(_device);
 
   // Connect to WiFi.  If saved Wifi settings are missing or invalid, creates a
   // captive portal that the end user can use to configure the device.
   Serial.println();
   Network network;
-  network.init(_device, localStorage);
+  network.init(_device, _localStorage);
 
   // Connect to Firebase.
   Serial.println();
-  _cloud.init(localStorage.getFirebaseHost(), localStorage.getFirebaseAuth());
-  
-  // Poll until we've been able to update our cloud-stored config for Firebase.
-  while (!_cloud.update(_device)) {
-    delay(30000);
-  }
+  _cloud.init(_localStorage.getFirebaseHost(), _localStorage.getFirebaseAuth());
+  _connectivity.init(millis(), WiFi.status() == WL_CONNECTED);
 
-  // Begin synchronizing the 'Time' library with the NTP server.
+  // Try to update our cloud-stored config from Firebase.  If we can't, we run with the last
+  // config we loaded (saved in flash), or the built-in defaults if there is none, and
+  // 'maybeLoadConfig()' retries from 'loop()'.  With only the built-in defaults, we sample and
+  // log but keep the relay open.
   Serial.println();
-  NTPTime ntp;
-  ntp.init(_cloud.getNtpServer(), _cloud.getGmtOffset());
+  _hasConfig = _cloud.restoreConfig(_localStorage);
+  maybeLoadConfig();
 
-  // Configure the thermistor class with Steinhart–Hart equation parameters from
-  // our config stored in Firebase.
-  Serial.println();
-  _thermistor.init(
-    _cloud.getSeriesResistor(),
-    _cloud.getResistanceAt0(),
-    _cloud.getTemperatureAt0(),
-    _cloud.getBCoefficient());
+  // Begin synchronizing the 'Time' library with the NTP server, and publish the config (which
+  // configures the thermistor with Steinhart–Hart equation parameters.)
+  _cloud.takeConfigChanges();
+  applyConfig(SUBSYSTEM_ALL);
 
   Serial.println("End: Setup()");
   _log.info("Initialized.");
 }
 
-// Returns ENGAGE if the collector should be engaged, DISENGAGE if it should be disengaged,
-// NONE if it should be left in its current state. 't0' is the temperature of the pool.
-// 't1' is the temperature of the collector.
-CollectorTransition getShouldEngageCollector(double t0, double t1) {
-  // If either the pool or the collector are below our minimum temperature, do
-  // not engage the collector.
-  double minT = _cloud.getMinTOn();
-  if (t0 < minT || t1 < minT) {
-    Serial.print("Temperature below minimum safe operating temperature "); + Serial.print(minT); Serial.println(" celsius.");
-    return CollectorTransition::DISENGAGE;
+// Publishes a new config snapshot and reconfigures the subsystems identified by 'subsystems'
+// (see 'ConfigSubsystem').  Derived state (thermistor coefficients, control and safety
+// thresholds) is rebuilt here, off the sampling path.
+void applyConfig(uint8_t subsystems) {
+  if (subsystems == 0) {
+    return;
   }
 
-  double maxT = _cloud.getMaxTOn();
-  if (t0 > maxT) {
-    Serial.print("Temperature has reached maximum temperature "); + Serial.print(maxT); Serial.println(" celsius.");
-    return CollectorTransition::DISENGAGE;
+  _configStore.publish(_cloud.getConfig());
+  const ConfigSnapshot& snapshot = _configStore.current();
+  const Config& config = snapshot.config;
+
+  if (subsystems & SUBSYSTEM_TIME) {
+    Serial.println();
+    NTPTime ntp;
+    ntp.init(config.getString(NTP_SERVER), static_cast<int8_t>(config.getInt(GMT_OFFSET)));
+    _clock.init(static_cast<int8_t>(config.getInt(GMT_OFFSET)));
   }
-  
-  // If the delta between the pool and collector is large, engage the collector.
-  // If the delta is small or negative, ensure the collector is not engaged.
-  double delta = t1 - t0;
-  double deltaTOn = _cloud.getDeltaTOn();
-  double deltaTOff = _cloud.getDeltaTOff();
-  
-  if (delta > deltaTOn) {
-//    Serial.print("Delta "); Serial.print(delta); Serial.print(" > "); Serial.print(deltaTOn); Serial.println(": Collector active.");
-    Serial.println(String("Delta ") + delta + " > " + deltaTOn + ": Collector active.");
-    return CollectorTransition::ENGAGE;
-  } else if (delta < deltaTOff) {
-//    Serial.print("Delta "); Serial.print(delta); Serial.print(" < "); Serial.print(deltaTOff); Serial.println(": Collector inactive.");
-    Serial.println(String("Delta ") + delta + " < " + deltaTOff + ": Collector inactive.");
-    return CollectorTransition::DISENGAGE;
+
+  if (subsystems & (SUBSYSTEM_THERMISTOR | SUBSYSTEM_CONTROL)) {
+    Serial.print("Config generation "); Serial.print(snapshot.generation);
+    Serial.print(": safety cutoff at pool adc < "); Serial.print(snapshot.safety.hotBelow);
+    Serial.print(" or any adc > "); Serial.println(snapshot.safety.coldAbove);
+  }
+}
+
+// Loads our config from Firebase if we have not yet done so, we're online, and the retry
+// interval has elapsed.  A config that loads successfully is saved to flash for the next boot.
+void maybeLoadConfig() {
+  if (_isConfigLoaded || !_connectivity.isOnline()
+    || static_cast<int32_t>(millis() - _nextConfigAttemptMs) < 0) {
+    return;
+  }
+
+  _isConfigLoaded = _cloud.update(_device);
+  if (_isConfigLoaded) {
+    _hasConfig = true;
+    _localStorage.saveCloudConfig(_cloud.getConfig());
   } else {
-    Serial.println(String("Delta ") + delta + " > " + deltaTOff + ", < " + deltaTOn + ": Collector unchanged.");
-    return CollectorTransition::NONE;
+    Serial.println("Using saved or built-in values for missing config.  Will retry.");
+    _nextConfigAttemptMs = millis() + CloudProtocol::_config_retry_ms;
+  }
+}
+
+// Advances the WiFi/Firebase reconnection state machine.  Never blocks.
+void maintainConnectivity() {
+  bool wasOnline = _connectivity.isOnline();
+  uint32_t now = millis();
+  Network::apply(_connectivity.poll(now, WiFi.status() == WL_CONNECTED));
+
+  if (wasOnline != _connectivity.isOnline()) {
+    Serial.print(_connectivity.isOnline() ? "Online" : "Offline");
+    Serial.print(" (reconnects: "); Serial.print(_connectivity.getReconnects());
+    Serial.print(", downtime: "); Serial.print(_connectivity.getDowntimeMs(now) / 1000); Serial.println(" s)");
+  }
+}
+
+// Returns ENGAGE if the collector should be engaged, DISENGAGE if it should be disengaged,
+// NONE if it should be left in its current state. 'params' are the thresholds from the config
+// snapshot.  't0' is the temperature of the pool.  't1' is the temperature of the collector.
+// 'trends' holds the pool and collector trends.  (See 'Controller.h' for the rules.)
+CollectorTransition getShouldEngageCollector(const ControlParameters& params, double t0, double t1, const Trend trends[2]) {
+  CollectorReason reason;
+  CollectorTransition transition = getCollectorTransition(params, t0, t1, reason);
+
+  Serial.print("Pool "); Serial.print(trends[0].perHour); Serial.print(" C/h (noise "); Serial.print(trends[0].noise);
+  Serial.print(" C), collector "); Serial.print(trends[1].perHour); Serial.print(" C/h (noise "); Serial.print(trends[1].noise); Serial.println(" C)");
+
+  double delta = t1 - t0;
+  switch (reason) {
+    case BELOW_MIN_T:
+      Serial.print("Temperature below minimum safe operating temperature "); Serial.print(params.minTOn); Serial.println(" celsius.");
+      break;
+    case ABOVE_MAX_T:
+      Serial.print("Temperature has reached maximum temperature "); Serial.print(params.maxTOn); Serial.println(" celsius.");
+      break;
+    case DELTA_ABOVE_ON:
+      Serial.println(String("Delta ") + delta + " > " + params.deltaTOn + ": Collector active.");
+      break;
+    case DELTA_BELOW_OFF:
+      Serial.println(String("Delta ") + delta + " < " + params.deltaTOff + ": Collector inactive.");
+      break;
+    case DELTA_BETWEEN:
+      Serial.println(String("Delta ") + delta + " > " + params.deltaTOff + ", < " + params.deltaTOn + ": Collector unchanged.");
+      break;
   }
+
+  return transition;
 }
 
 void loop() {
-  int oversample = _cloud.getOversample();                      // # of samples to take for each loop.
-  int duration = _cloud.getPollingMilliseconds() / oversample;  // Duration between sample points.
+  // Every setting used in this iteration comes from the same snapshot.
+  const ConfigSnapshot& snapshot = _configStore.current();
+  const Config& config = snapshot.config;
+  int oversample = config.getInt(OVERSAMPLE);                           // # of samples to take for each loop.
+  int duration = config.getInt(POLLING_MILLISECONDS) / oversample;      // Duration between sample points.
+  double statsWindow = config.getFloat(STATS_WINDOW_SECONDS);
 
-  // Takes evenly spaced samples through the 'getPollingMilliseconds()' period.
+  // Takes evenly spaced samples through the 'POLLING_MILLISECONDS' period.  Each sample is
+  // timestamped as it is taken, and the period is timestamped with the mean of those times.
   double adc[2] = {};
+  uint64_t timestampSum = 0;
+  int timestamped = 0;
   for (int i = 0; i < oversample; i++) {
     delay(duration);    
+    maintainConnectivity();
+    _clock.poll();
+    uint64_t sampledAt = _clock.nowMillis();
+    uint32_t now = millis();
+    if (sampledAt > 0) {
+      timestampSum += sampledAt;
+      timestamped++;
+    }
+
     for (int channel = 0; channel < 2; channel++) {
       uint32_t sample = _device.readAdc(channel);
       Serial.print("adc"); Serial.print(channel); Serial.print(": "); Serial.println(sample);
       adc[channel] += sample;
+      _stats[channel].add(now, sample, statsWindow);
+
+      // Don't wait for the end of the period to disengage the collector if the raw samples
+      // are out of range.
+      if (_safety.check(snapshot.safety, channel, sample) && _device.getRelay()) {
+        _device.setRelay(false);
+      }
     }
   }
 
-  // Record timestamp and convert ADC averages to temperature readings.
-  time_t timestamp = now();
-  ThermistorReading t0 = _thermistor.toReading(adc[0] / oversample);
-  ThermistorReading t1 = _thermistor.toReading(adc[1] / oversample);
+  SafetyCutoff::Event event;
+  while (_safety.takeEvent(event)) {
+    _log.warn(String("Safety cutoff: adc") + event.channel + " = " + event.adc
+      + (event.reason == ABOVE_MAX_T ? " above maximum temperature." : " below minimum temperature."));
+  }
+
+  // Convert ADC averages to temperature readings.  (The timestamp is 0 if the clock became
+  // valid part way through the period, in which case the server timestamps the record.)
+  uint64_t timestamp = timestamped == oversample
+    ? timestampSum / oversample
+    : 0;
+  ThermistorReading t0 = snapshot.thermistor.toReading(adc[0] / oversample);
+  ThermistorReading t1 = snapshot.thermistor.toReading(adc[1] / oversample);
 
   Serial.print("adc0: "); t0.print();
   Serial.print("adc1: "); t1.print();
 
+  Trend trends[2] = { _stats[0].getTrend(snapshot.thermistor), _stats[1].getTrend(snapshot.thermistor) };
+
   // Given the temperature data, engage/disengage the collector as appropriate.
-  CollectorTransition transition = getShouldEngageCollector(t0._celsius, t1._celsius);
+  CollectorTransition transition = getShouldEngageCollector(snapshot.control, t0._celsius, t1._celsius, trends);
+  if (transition == CollectorTransition::ENGAGE && _safety.isTripped()) {
+    Serial.println("Safety cutoff tripped: Collector inactive.");
+    transition = CollectorTransition::DISENGAGE;
+  }
+  if (transition == CollectorTransition::ENGAGE && !_hasConfig) {
+    // The built-in defaults may not suit this installation (e.g., its thermistors or limits.)
+    Serial.println("No config loaded yet: Collector inactive.");
+    transition = CollectorTransition::DISENGAGE;
+  }
   if (transition != CollectorTransition::NONE) {
     _device.setRelay(transition == CollectorTransition::ENGAGE);
   }
-  // Log the temperature data for this period, and the state of the solar collector.
-  _cloud.log(_device, timestamp, t0._adc, t1._adc, _device.getRelay());
-//  _cloud.log(_device, timestamp, t0._celsius, t1._celsius, _device.getRelay());
+
+  // Loading config and logging block for seconds at a time, so keep checking the samples (at
+  // the same interval as above) until they are done.
+  _safetyWatch.arm(snapshot.safety, duration);
+
+  // Pick up our cloud config once we're online, if we started without it.
+  if (!_isConfigLoaded) {
+    maybeLoadConfig();
+    applyConfig(_cloud.takeConfigChanges());
+  }
+
+  // Log the temperature data for this period, and the state of the solar collector.  (While
+  // offline, we skip logging rather than block the control loop on timeouts.  Until our config
+  // is loaded, we don't know how many log entries to use.)
+  // Samples within 'UPLOAD_DEADBAND' of the last logged sample are skipped, up to the
+  // 'HEARTBEAT_MILLISECONDS' interval.
+  if (_connectivity.isOnline() && _isConfigLoaded) {
+    uint32_t now = millis();
+    bool active = _device.getRelay();
+    if (_uploadFilter.shouldUpload(now, t0._adc, t1._adc, active,
+          config.getFloat(UPLOAD_DEADBAND), config.getInt(HEARTBEAT_MILLISECONDS))) {
+      bool success = _cloud.log(_device, timestamp, t0._adc, t1._adc, active, trends[0], trends[1],
+        _uploadFilter.getSkipped(), config.getInt(MAX_ENTRIES));
+//    bool success = _cloud.log(_device, timestamp, t0._celsius, t1._celsius, active, trends[0], trends[1],
+//      _uploadFilter.getSkipped(), config.getInt(MAX_ENTRIES));
+      _connectivity.reportCloudResult(success);
+      if (success) {
+        _uploadFilter.uploaded(now, t0._adc, t1._adc, active);
+      }
+    } else {
+      Serial.print("  Unchanged; skipped "); Serial.print(_uploadFilter.getSkipped()); Serial.println(" sample(s).");
+    }
+  }
+
+  _safetyWatch.disarm();
   Serial.println();
 }
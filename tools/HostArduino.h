@@ -0,0 +1,62 @@
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+
+/*
+ * HostArduino.h - Minimal stand-in for the parts of 'Arduino.h' used by the firmware headers
+ * (e.g., 'Thermistor.h') so that they can be compiled into host tools unmodified.
+ *
+ * 'Serial' output goes to stderr so that it does not mix with a tool's data on stdout.
+ *
+ * Tools that include headers which use the ESP8266 SDK ('<pgmspace.h>', '<sntp.h>') build with
+ * '-I .' to pick up the stand-ins in this directory.  Tools that include 'Clock.h' define
+ * 'micros64()', 'yield()' and 'sntp_get_current_timestamp()' to simulate time.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+uint64_t micros64();
+void yield();
+
+class Print {
+  public:
+    virtual ~Print() { }
+    virtual void write(const char* text) = 0;
+
+    void print(const char* value)     { write(value); }
+    void print(char value)            { char text[2] = { value, '\0' }; write(text); }
+    void print(int value)             { format("%d", value); }
+    void print(unsigned value)        { format("%u", value); }
+    void print(long value)            { format("%ld", value); }
+    void print(unsigned long value)   { format("%lu", value); }
+    void print(double value, int digits = 2) { format("%.*f", digits, value); }
+
+    void println()                    { write("\n"); }
+    template <typename T> void println(T value) { print(value); println(); }
+
+  private:
+    template <typename... Args> void format(const char* format, Args... args) {
+      char text[64];
+      snprintf(text, sizeof(text), format, args...);
+      write(text);
+    }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual size_t readBytesUntil(char terminator, char* buffer, size_t length) = 0;
+};
+
+class HostSerial : public Print {
+  public:
+    void write(const char* text) override { fputs(text, stderr); }
+};
+
+static HostSerial Serial;
+
+#endif // __HOST_ARDUINO_H__
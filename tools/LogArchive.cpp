@@ -0,0 +1,314 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include "LogArchive.h"
+
+namespace {
+  const char _magic[8] = "DTCLOG2";
+  const char* const _index_file_name = "index.txt";
+  const float _adc_scale = 64.0f;
+
+  enum { TIME_COLUMN = 0, ADC0_COLUMN, ADC1_COLUMN, ACTIVE_COLUMN, SKIPPED_COLUMN, COLUMN_COUNT };
+
+  // On-disk chunk header.  The 5 column sizes bring 'minTime' to its natural alignment, so there
+  // is no padding.
+  struct ChunkHeader {
+    char magic[8];
+    uint32_t count;
+    uint32_t columnSizes[COLUMN_COUNT];
+    int64_t minTime;
+    int64_t maxTime;
+  };
+  static_assert(sizeof(ChunkHeader) == 48, "Chunk header layout must match 'LogArchive.h'.");
+
+  void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+  }
+
+  // Reads a varint from [p, end).  Returns false if the input is truncated.
+  bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+      uint8_t byte = *p++;
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint64_t zigzag(int64_t value)    { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+  int64_t unzigzag(uint64_t value)  { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+  int32_t toFixed(float adc)        { return static_cast<int32_t>(lroundf(adc * _adc_scale)); }
+  float fromFixed(int64_t fixed)    { return fixed / _adc_scale; }
+
+  std::string pathOf(const std::string& directory, const std::string& fileName) {
+    return directory + "/" + fileName;
+  }
+
+  // Decodes the chunk in [data, data + size) and appends the records in [from, to] to 'records'.
+  bool decodeChunk(const uint8_t* data, size_t size, int64_t from, int64_t to, std::vector<LogRecord>& records) {
+    ChunkHeader header;
+    if (size < sizeof(header)) {
+      return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, _magic, sizeof(_magic)) != 0) {
+      return false;
+    }
+
+    const uint8_t* columns[COLUMN_COUNT];
+    const uint8_t* p = data + sizeof(header);
+    for (int column = 0; column < COLUMN_COUNT; column++) {
+      columns[column] = p;
+      p += header.columnSizes[column];
+      if (p > data + size) {
+        return false;
+      }
+    }
+
+    const uint8_t* times = columns[TIME_COLUMN];
+    const uint8_t* adc0 = columns[ADC0_COLUMN];
+    const uint8_t* adc1 = columns[ADC1_COLUMN];
+    const uint8_t* active = columns[ACTIVE_COLUMN];
+    const uint8_t* skipped = columns[SKIPPED_COLUMN];
+    const uint8_t* skippedEnd = p;
+
+    int64_t time = header.minTime;
+    int64_t fixed0 = 0;
+    int64_t fixed1 = 0;
+    for (uint32_t i = 0; i < header.count; i++) {
+      uint64_t delta, delta0, delta1, skippedCount;
+      if (!getVarint(times, columns[ADC0_COLUMN], delta)
+        || !getVarint(adc0, columns[ADC1_COLUMN], delta0)
+        || !getVarint(adc1, columns[ACTIVE_COLUMN], delta1)
+        || !getVarint(skipped, skippedEnd, skippedCount)) {
+        return false;
+      }
+
+      time += static_cast<int64_t>(delta);
+      fixed0 += unzigzag(delta0);
+      fixed1 += unzigzag(delta1);
+
+      // Records are sorted by time, so we can stop at the first record past the range.
+      if (time > to) {
+        break;
+      }
+      if (time >= from) {
+        bool isActive = (active[i / 8] & (1 << (i % 8))) != 0;
+        records.push_back({ time, fromFixed(fixed0), fromFixed(fixed1), isActive, static_cast<uint32_t>(skippedCount) });
+      }
+    }
+
+    return true;
+  }
+}
+
+bool readLogArchiveIndex(const std::string& directory, std::vector<LogChunkInfo>& chunks) {
+  std::string path = pathOf(directory, _index_file_name);
+  FILE* file = fopen(path.c_str(), "r");
+  if (!file) {
+    return errno == ENOENT;
+  }
+
+  char line[512];
+  bool success = true;
+  while (fgets(line, sizeof(line), file)) {
+    LogChunkInfo chunk;
+    char fileName[256];
+    if (sscanf(line, "%" SCNd64 " %" SCNd64 " %" SCNu32 " %255s", &chunk.minTime, &chunk.maxTime, &chunk.count, fileName) != 4) {
+      fprintf(stderr, "Malformed line in '%s': %s", path.c_str(), line);
+      success = false;
+      break;
+    }
+    chunk.fileName = fileName;
+    chunks.push_back(chunk);
+  }
+
+  fclose(file);
+  return success;
+}
+
+LogArchiveWriter::LogArchiveWriter(const std::string& directory, size_t chunkSize)
+  : _directory(directory), _chunk_size(chunkSize) { }
+
+bool LogArchiveWriter::open() {
+  if (mkdir(_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Could not create '%s': %s\n", _directory.c_str(), strerror(errno));
+    return false;
+  }
+
+  if (!readLogArchiveIndex(_directory, _chunks)) {
+    return false;
+  }
+
+  for (const LogChunkInfo& chunk : _chunks) {
+    _archived_max_time = std::max(_archived_max_time, chunk.maxTime);
+  }
+  return true;
+}
+
+bool LogArchiveWriter::add(const LogRecord& record) {
+  if (record.time <= _archived_max_time) {
+    _skipped++;
+    return true;
+  }
+
+  _pending.push_back(record);
+  _added++;
+  return _pending.size() < _chunk_size || flush();
+}
+
+bool LogArchiveWriter::flush() {
+  if (_pending.empty()) {
+    return true;
+  }
+
+  std::sort(_pending.begin(), _pending.end(),
+    [](const LogRecord& left, const LogRecord& right) { return left.time < right.time; });
+
+  std::vector<uint8_t> columns[COLUMN_COUNT];
+  columns[ACTIVE_COLUMN].resize((_pending.size() + 7) / 8);
+
+  int64_t previousTime = _pending.front().time;
+  int64_t previous0 = 0;
+  int64_t previous1 = 0;
+  for (size_t i = 0; i < _pending.size(); i++) {
+    const LogRecord& record = _pending[i];
+    int32_t fixed0 = toFixed(record.adc0);
+    int32_t fixed1 = toFixed(record.adc1);
+
+    putVarint(columns[TIME_COLUMN], static_cast<uint64_t>(record.time - previousTime));
+    putVarint(columns[ADC0_COLUMN], zigzag(fixed0 - previous0));
+    putVarint(columns[ADC1_COLUMN], zigzag(fixed1 - previous1));
+    if (record.active) {
+      columns[ACTIVE_COLUMN][i / 8] |= 1 << (i % 8);
+    }
+    putVarint(columns[SKIPPED_COLUMN], record.skipped);
+
+    previousTime = record.time;
+    previous0 = fixed0;
+    previous1 = fixed1;
+  }
+
+  ChunkHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, _magic, sizeof(_magic));
+  header.count = static_cast<uint32_t>(_pending.size());
+  for (int column = 0; column < COLUMN_COUNT; column++) {
+    header.columnSizes[column] = static_cast<uint32_t>(columns[column].size());
+  }
+  header.minTime = _pending.front().time;
+  header.maxTime = _pending.back().time;
+
+  char fileName[32];
+  snprintf(fileName, sizeof(fileName), "chunk-%06zu.dtc", _chunks.size());
+
+  // Write to a temporary file and rename, so an interrupted ingest never leaves a partial chunk
+  // that the index refers to.
+  std::string path = pathOf(_directory, fileName);
+  std::string temporaryPath = path + ".tmp";
+  FILE* file = fopen(temporaryPath.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "Could not create '%s': %s\n", temporaryPath.c_str(), strerror(errno));
+    return false;
+  }
+
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (int column = 0; success && column < COLUMN_COUNT; column++) {
+    success = fwrite(columns[column].data(), 1, columns[column].size(), file) == columns[column].size();
+  }
+  success &= fclose(file) == 0;
+  success = success && rename(temporaryPath.c_str(), path.c_str()) == 0;
+  if (!success) {
+    fprintf(stderr, "Could not write '%s': %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+
+  _chunks.push_back({ header.minTime, header.maxTime, header.count, fileName });
+  _pending.clear();
+  return writeIndex();
+}
+
+bool LogArchiveWriter::writeIndex() const {
+  std::string path = pathOf(_directory, _index_file_name);
+  std::string temporaryPath = path + ".tmp";
+  FILE* file = fopen(temporaryPath.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "Could not create '%s': %s\n", temporaryPath.c_str(), strerror(errno));
+    return false;
+  }
+
+  for (const LogChunkInfo& chunk : _chunks) {
+    fprintf(file, "%" PRId64 " %" PRId64 " %" PRIu32 " %s\n", chunk.minTime, chunk.maxTime, chunk.count, chunk.fileName.c_str());
+  }
+
+  bool success = fclose(file) == 0 && rename(temporaryPath.c_str(), path.c_str()) == 0;
+  if (!success) {
+    fprintf(stderr, "Could not write '%s': %s\n", path.c_str(), strerror(errno));
+  }
+  return success;
+}
+
+bool LogArchiveWriter::close() {
+  return flush();
+}
+
+bool LogArchiveReader::open(const std::string& directory) {
+  _directory = directory;
+  _chunks.clear();
+  return readLogArchiveIndex(directory, _chunks);
+}
+
+bool LogArchiveReader::query(int64_t from, int64_t to, std::vector<LogRecord>& records) {
+  size_t first = records.size();
+
+  for (const LogChunkInfo& chunk : _chunks) {
+    if (chunk.maxTime < from || chunk.minTime > to) {
+      continue;
+    }
+
+    std::string path = pathOf(_directory, chunk.fileName);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+      fprintf(stderr, "Could not open '%s': %s\n", path.c_str(), strerror(errno));
+      if (fd >= 0) { ::close(fd); }
+      return false;
+    }
+
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "Could not map '%s': %s\n", path.c_str(), strerror(errno));
+      return false;
+    }
+
+    bool success = decodeChunk(static_cast<const uint8_t*>(data), info.st_size, from, to, records);
+    munmap(data, info.st_size);
+    _chunks_read++;
+
+    if (!success) {
+      fprintf(stderr, "Corrupt chunk '%s'\n", path.c_str());
+      return false;
+    }
+  }
+
+  // Chunks from different exports may overlap in time.
+  std::stable_sort(records.begin() + first, records.end(),
+    [](const LogRecord& left, const LogRecord& right) { return left.time < right.time; });
+  return true;
+}
@@ -0,0 +1,106 @@
+#ifndef __LOG_ARCHIVE_H__
+#define __LOG_ARCHIVE_H__
+
+/*
+ * LogArchive.h - Columnar, compressed archive of the samples logged by the firmware.
+ *
+ * An archive is a directory containing:
+ *
+ *    index.txt           One line per chunk: '<min time> <max time> <count> <file name>'.
+ *    chunk-NNNNNN.dtc    Up to 'chunkSize' records, sorted by time, stored column by column.
+ *
+ * Chunk file layout (little endian, 48 byte header):
+ *
+ *    0   char[8]   magic ("DTCLOG2")
+ *    8   uint32    record count
+ *    12  uint32[5] size in bytes of each of the 5 columns that follow the header
+ *    32  int64     min time (UTC milliseconds)
+ *    40  int64     max time (UTC milliseconds)
+ *    48  columns:
+ *        time:     varint deltas from the previous record (the first from 'min time')
+ *        adc0:     zigzag varint deltas of round(adc * 64)
+ *        adc1:     zigzag varint deltas of round(adc * 64)
+ *        active:   1 bit per record
+ *        skipped:  varint per record
+ *
+ * ADC values are averages of 'oversample' readings, so 1/64 fixed point is exact for
+ * 'oversample' up to 64 (and within 0.008 of an ADC code otherwise.)
+ *
+ * 'LogArchiveReader' memory-maps only the chunks whose time range overlaps a query.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct LogRecord {
+  int64_t time;                     // UTC milliseconds since 1970.
+  float adc0;                       // Pool ADC average [0..1023]
+  float adc1;                       // Collector ADC average [0..1023]
+  bool active;                      // True if the collector was engaged.
+  uint32_t skipped;                 // Unchanged samples the device didn't log before this one.
+};
+
+struct LogChunkInfo {
+  int64_t minTime;
+  int64_t maxTime;
+  uint32_t count;
+  std::string fileName;
+};
+
+class LogArchiveWriter {
+  private:
+    std::string _directory;
+    size_t _chunk_size;
+    std::vector<LogChunkInfo> _chunks;          // Existing chunks followed by chunks we've written.
+    std::vector<LogRecord> _pending;            // Records not yet written to a chunk.
+    int64_t _archived_max_time = INT64_MIN;     // Records at or before this time are already archived.
+    size_t _added = 0;
+    size_t _skipped = 0;
+
+    bool flush();
+    bool writeIndex() const;
+
+  public:
+    LogArchiveWriter(const std::string& directory, size_t chunkSize = 64 * 1024);
+
+    // Loads the index of an existing archive in 'directory' (if any).  Returns false on error.
+    bool open();
+
+    // Adds 'record' to the archive.  Records no newer than the newest record already in the
+    // archive when it was opened are skipped, so that overlapping exports can be ingested.
+    bool add(const LogRecord& record);
+
+    // Writes any pending records and the updated index.  Returns false on error.
+    bool close();
+
+    size_t getAdded() const     { return _added; }
+    size_t getSkipped() const   { return _skipped; }
+};
+
+class LogArchiveReader {
+  private:
+    std::string _directory;
+    std::vector<LogChunkInfo> _chunks;
+    size_t _chunks_read = 0;
+
+  public:
+    // Loads the index of the archive in 'directory'.  Returns false on error.
+    bool open(const std::string& directory);
+
+    // Appends the records with 'from' <= time <= 'to' to 'records', sorted by time.  Returns
+    // false if a chunk could not be read.
+    bool query(int64_t from, int64_t to, std::vector<LogRecord>& records);
+
+    const std::vector<LogChunkInfo>& getChunks() const  { return _chunks; }
+
+    // Number of chunk files mapped by 'query()' so far.
+    size_t getChunksRead() const                        { return _chunks_read; }
+};
+
+// Reads the index file of the archive in 'directory' into 'chunks'.  A missing index is an
+// empty archive.
+bool readLogArchiveIndex(const std::string& directory, std::vector<LogChunkInfo>& chunks);
+
+#endif // __LOG_ARCHIVE_H__
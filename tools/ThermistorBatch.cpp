@@ -0,0 +1,223 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "ThermistorBatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define THERMISTOR_BATCH_X86 1
+#endif
+
+/* static */ const float ThermistorBatch::_k = 273.15f;
+
+namespace {
+  const float _adc_max = 1023.0f;
+  bool _vector_disabled = false;       // See 'ThermistorBatch::setVectorized()'.
+  const float _ln2 = 0.693147180559945f;
+  const float _sqrt2 = 1.41421356237310f;
+
+  // Coefficients of ln(m) = 2 * (t + t^3/3 + t^5/5 + t^7/7 + t^9/9), where t = (m - 1) / (m + 1).
+  // For m in [sqrt(1/2), sqrt(2)), |t| < 0.1716 and the truncation error is below 1e-9.
+  const float _c1 = 2.0f;
+  const float _c3 = 2.0f / 3.0f;
+  const float _c5 = 2.0f / 5.0f;
+  const float _c7 = 2.0f / 7.0f;
+  const float _c9 = 2.0f / 9.0f;
+
+  // Parameters shared by the scalar and vector kernels.  The kernels compute:
+  //
+  //    out = scale * (1 / (ln(adc / (1023 - adc) * rsOverR0) * invB + invT0)) + offset
+  //
+  // or 'invalid' when adc is outside (0, 1023).
+  struct Kernel {
+    float rsOverR0;
+    float invB;
+    float invT0;
+    float scale;
+    float offset;
+    float invalid;
+  };
+
+  // Scalar version of the 'log()' approximation used by the vector kernel.
+  inline float approximateLog(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127;
+    bits = (bits & 0x007FFFFF) | 0x3F800000;    // Mantissa in [1, 2)
+
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    if (m > _sqrt2) {
+      m *= 0.5f;
+      exponent++;
+    }
+
+    float t = (m - 1.0f) / (m + 1.0f);
+    float t2 = t * t;
+    float p = _c9;
+    p = p * t2 + _c7;
+    p = p * t2 + _c5;
+    p = p * t2 + _c3;
+    p = p * t2 + _c1;
+    return p * t + static_cast<float>(exponent) * _ln2;
+  }
+
+  void convertScalar(const Kernel& kernel, const float* adc, float* out, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      float a = adc[i];
+      if (!(a > 0.0f && a < _adc_max)) {
+        out[i] = kernel.invalid;
+        continue;
+      }
+
+      float x = a / (_adc_max - a) * kernel.rsOverR0;             // R / R0
+      float invT = approximateLog(x) * kernel.invB + kernel.invT0;  // 1/B * ln(R/R0) + 1/T0
+      out[i] = kernel.scale / invT + kernel.offset;
+    }
+  }
+
+#ifdef THERMISTOR_BATCH_X86
+  __attribute__((target("avx2,fma")))
+  inline __m256 approximateLog8(__m256 x) {
+    const __m256i mantissaMask = _mm256_set1_epi32(0x007FFFFF);
+    const __m256i one = _mm256_set1_epi32(0x3F800000);
+
+    __m256i bits = _mm256_castps_si256(x);
+    __m256i exponentBits = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, mantissaMask), one));
+    __m256 exponent = _mm256_cvtepi32_ps(exponentBits);
+
+    // If m > sqrt(2), halve m and increment the exponent.
+    __m256 isLarge = _mm256_cmp_ps(m, _mm256_set1_ps(_sqrt2), _CMP_GT_OQ);
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), isLarge);
+    exponent = _mm256_add_ps(exponent, _mm256_and_ps(isLarge, _mm256_set1_ps(1.0f)));
+
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)), _mm256_add_ps(m, _mm256_set1_ps(1.0f)));
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 p = _mm256_set1_ps(_c9);
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(_c7));
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(_c5));
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(_c3));
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(_c1));
+    return _mm256_fmadd_ps(p, t, _mm256_mul_ps(exponent, _mm256_set1_ps(_ln2)));
+  }
+
+  __attribute__((target("avx2,fma")))
+  void convertAvx2(const Kernel& kernel, const float* adc, float* out, size_t begin, size_t end) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 adcMax = _mm256_set1_ps(_adc_max);
+    const __m256 rsOverR0 = _mm256_set1_ps(kernel.rsOverR0);
+    const __m256 invB = _mm256_set1_ps(kernel.invB);
+    const __m256 invT0 = _mm256_set1_ps(kernel.invT0);
+    const __m256 scale = _mm256_set1_ps(kernel.scale);
+    const __m256 offset = _mm256_set1_ps(kernel.offset);
+    const __m256 invalid = _mm256_set1_ps(kernel.invalid);
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+      __m256 a = _mm256_loadu_ps(adc + i);
+      __m256 valid = _mm256_and_ps(
+        _mm256_cmp_ps(a, zero, _CMP_GT_OQ),
+        _mm256_cmp_ps(a, adcMax, _CMP_LT_OQ));
+
+      // Substitute a harmless value for invalid lanes so they do not produce NaN/Inf.
+      a = _mm256_blendv_ps(_mm256_set1_ps(1.0f), a, valid);
+
+      __m256 x = _mm256_mul_ps(_mm256_div_ps(a, _mm256_sub_ps(adcMax, a)), rsOverR0);
+      __m256 invT = _mm256_fmadd_ps(approximateLog8(x), invB, invT0);
+      __m256 result = _mm256_add_ps(_mm256_div_ps(scale, invT), offset);
+      _mm256_storeu_ps(out + i, _mm256_blendv_ps(invalid, result, valid));
+    }
+
+    convertScalar(kernel, adc, out, i, end);
+  }
+#endif // THERMISTOR_BATCH_X86
+
+  void convert(const Kernel& kernel, const float* adc, float* out, size_t begin, size_t end) {
+#ifdef THERMISTOR_BATCH_X86
+    if (ThermistorBatch::isVectorized()) {
+      convertAvx2(kernel, adc, out, begin, end);
+      return;
+    }
+#endif
+    convertScalar(kernel, adc, out, begin, end);
+  }
+
+  Kernel makeKernel(float rsOverR0, float invB, float invT0, float scale, float offset) {
+    // 1/T is in Kelvin; fold the conversion to Celsius (and the caller's scale/offset) together.
+    Kernel kernel = { rsOverR0, invB, invT0, scale, offset - ThermistorBatch::_k * scale, 0 };
+    kernel.invalid = kernel.offset;
+    return kernel;
+  }
+}
+
+ThermistorBatch::ThermistorBatch(double rs, double r0, double t0, double b)
+  : _rs_over_r0(static_cast<float>(rs / r0)),
+    _rs(static_cast<float>(rs)),
+    _inv_b(static_cast<float>(1.0 / b)),
+    _inv_t0(static_cast<float>(1.0 / (t0 + _k))) { }
+
+/* static */ bool ThermistorBatch::isVectorized() {
+#ifdef THERMISTOR_BATCH_X86
+  static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return supported && !_vector_disabled;
+#else
+  return false;
+#endif
+}
+
+/* static */ bool ThermistorBatch::setVectorized(bool enabled) {
+  _vector_disabled = !enabled;
+  return isVectorized();
+}
+
+void ThermistorBatch::toResistance(const float* adc, float* ohms, size_t count) const {
+  // A single division per value; the compiler vectorizes this loop without help.
+  for (size_t i = 0; i < count; i++) {
+    ohms[i] = _rs * adc[i] / (_adc_max - adc[i]);     // Same as rs / ((1023 / adc) - 1)
+  }
+}
+
+void ThermistorBatch::toCelsius(const float* adc, float* celsius, size_t count) const {
+  convert(makeKernel(_rs_over_r0, _inv_b, _inv_t0, 1.0f, 0.0f), adc, celsius, 0, count);
+}
+
+void ThermistorBatch::toFahrenheit(const float* adc, float* fahrenheit, size_t count) const {
+  convert(makeKernel(_rs_over_r0, _inv_b, _inv_t0, 1.8f, 32.0f), adc, fahrenheit, 0, count);
+}
+
+void ThermistorBatch::toCelsiusParallel(const float* adc, float* celsius, size_t count, unsigned threads) const {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // Not worth starting threads for less than ~1M values per thread.
+  const size_t minPerThread = 1 << 20;
+  threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, count / minPerThread)));
+
+  Kernel kernel = makeKernel(_rs_over_r0, _inv_b, _inv_t0, 1.0f, 0.0f);
+  if (threads == 1) {
+    convert(kernel, adc, celsius, 0, count);
+    return;
+  }
+
+  // Split into contiguous, 64-byte aligned ranges so threads do not share cache lines.
+  size_t perThread = ((count / threads) + 15) & ~static_cast<size_t>(15);
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    size_t begin = std::min(count, t * perThread);
+    size_t end = t + 1 == threads ? count : std::min(count, begin + perThread);
+    workers.emplace_back([&kernel, adc, celsius, begin, end]() {
+      convert(kernel, adc, celsius, begin, end);
+    });
+  }
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef __THERMISTOR_BATCH_H__
+#define __THERMISTOR_BATCH_H__
+
+/*
+ * ThermistorBatch.h - Host-side bulk conversion of logged ADC values to temperatures.
+ *
+ * Computes the same Steinhart-Hart conversion as 'Thermistor::toReading()' (firmware/Thermistor.h)
+ * over arrays of ADC averages, in single precision.  Uses AVX2/FMA when the CPU supports it and
+ * a scalar loop otherwise.  Both paths use the same polynomial approximation of 'log()', but FMA
+ * rounds differently from separate multiplies and adds, so results differ between the paths in
+ * the last bits (up to ~6e-5 Celsius for the default coefficients.)  Both are within the
+ * accuracy below.
+ *
+ * Accuracy: the 'log()' approximation has a relative error below 2^-22, which is less than
+ * 0.0005 degrees Celsius over the sensor's range.  Run 'thermistor-batch verify' to measure the
+ * error of each path against 'Thermistor::toReading()' for a given set of coefficients.
+ *
+ * ADC values <= 0 or >= 1023 (open/shorted thermistor) map to -273.15 C, as they do in
+ * 'Thermistor'.
+ */
+
+#include <stddef.h>
+
+class ThermistorBatch {
+  private:
+    float _rs_over_r0;                  // Series resistor / thermistor resistance at '_t0'.
+    float _rs;                          // Value of resistor in voltage divider (in Ohms)
+    float _inv_b;                       // 1 / 'B' coefficient
+    float _inv_t0;                      // 1 / temperature at which thermistor has resistance 'r0' (in Kelvin)
+
+  public:
+    static const float _k;              // 0 degrees Celsius in Kelvin
+
+    // Same parameters as 'Thermistor::init()'.  ('t0' is in Celsius.)
+    ThermistorBatch(double rs, double r0, double t0, double b);
+
+    // Converts 'count' ADC values [0..1023] to thermistor resistance (in Ohms).
+    void toResistance(const float* adc, float* ohms, size_t count) const;
+
+    // Converts 'count' ADC values [0..1023] to temperature (in Celsius).
+    void toCelsius(const float* adc, float* celsius, size_t count) const;
+
+    // Converts 'count' ADC values [0..1023] to temperature (in Fahrenheit).
+    void toFahrenheit(const float* adc, float* fahrenheit, size_t count) const;
+
+    // As 'toCelsius()', splitting the work across 'threads' threads (0 = one per core.)
+    void toCelsiusParallel(const float* adc, float* celsius, size_t count, unsigned threads = 0) const;
+
+    // True if the AVX2 path is used on this CPU.
+    static bool isVectorized();
+
+    // Selects the scalar path even if the CPU supports AVX2 (used by 'thermistor-batch verify'
+    // to check both paths.)  Returns 'isVectorized()'.
+    static bool setVectorized(bool enabled);
+};
+
+#endif // __THERMISTOR_BATCH_H__
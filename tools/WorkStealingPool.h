@@ -0,0 +1,156 @@
+#ifndef __WORK_STEALING_POOL_H__
+#define __WORK_STEALING_POOL_H__
+
+/*
+ * WorkStealingPool.h - Fixed set of worker threads, each with its own task deque.
+ *
+ * 'submit()' distributes tasks round-robin.  Each worker runs tasks from the back of its own
+ * deque and, when that is empty, steals from the front of the other workers' deques, so uneven
+ * task costs balance out without a single contended queue.  'wait()' blocks until every
+ * submitted task has finished.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+  private:
+    struct Worker {
+      std::mutex mutex;
+      std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::thread> _threads;
+    std::atomic<size_t> _next_worker{0};
+
+    std::mutex _mutex;                          // Guards '_pending' and '_stopping' for the condition variables.
+    std::condition_variable _work_available;
+    std::condition_variable _all_done;
+    size_t _pending = 0;                        // Submitted tasks that have not yet finished.
+    bool _stopping = false;
+
+    bool popOwn(size_t index, std::function<void()>& task) {
+      Worker& worker = *_workers[index];
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      if (worker.tasks.empty()) {
+        return false;
+      }
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      return true;
+    }
+
+    bool steal(size_t thief, std::function<void()>& task) {
+      for (size_t i = 1; i < _workers.size(); i++) {
+        Worker& victim = *_workers[(thief + i) % _workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+          task = std::move(victim.tasks.front());
+          victim.tasks.pop_front();
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void run(size_t index) {
+      std::function<void()> task;
+      for (;;) {
+        if (popOwn(index, task) || steal(index, task)) {
+          task();
+          task = nullptr;
+
+          std::lock_guard<std::mutex> lock(_mutex);
+          if (--_pending == 0) {
+            _all_done.notify_all();
+          }
+          continue;
+        }
+
+        // Nothing to run.  Sleep until more work is submitted (re-checking under the lock so
+        // that a concurrent 'submit()' is not missed.)
+        std::unique_lock<std::mutex> lock(_mutex);
+        _work_available.wait(lock, [this]() {
+          return _stopping || hasQueuedTasks();
+        });
+        if (_stopping && !hasQueuedTasks()) {
+          return;
+        }
+      }
+    }
+
+    bool hasQueuedTasks() {
+      for (std::unique_ptr<Worker>& worker : _workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->tasks.empty()) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+  public:
+    // Starts 'threads' workers (0 = one per core.)
+    explicit WorkStealingPool(unsigned threads = 0) {
+      if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      }
+
+      for (unsigned i = 0; i < threads; i++) {
+        _workers.emplace_back(new Worker());
+      }
+      for (unsigned i = 0; i < threads; i++) {
+        _threads.emplace_back(&WorkStealingPool::run, this, i);
+      }
+    }
+
+    ~WorkStealingPool() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+      }
+      _work_available.notify_all();
+      for (std::thread& thread : _threads) {
+        thread.join();
+      }
+    }
+
+    void submit(std::function<void()> task) {
+      size_t index = _next_worker++ % _workers.size();
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending++;
+      }
+      {
+        Worker& worker = *_workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+      }
+      {
+        // Notify while holding '_mutex' so a worker between its empty check and its wait
+        // cannot miss the wakeup.
+        std::lock_guard<std::mutex> lock(_mutex);
+        _work_available.notify_one();
+      }
+    }
+
+    // Blocks until all submitted tasks have finished.
+    void wait() {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _all_done.wait(lock, [this]() { return _pending == 0; });
+    }
+
+    size_t size() const {
+      return _workers.size();
+    }
+};
+
+#endif // __WORK_STEALING_POOL_H__
@@ -0,0 +1,136 @@
+/*
+ * clock-sim - Runs firmware/Clock.h against a simulated SNTP clock and a drifting local
+ * oscillator, to check how soon 'poll()' anchors the clock, how long any call to 'poll()' takes
+ * and how well the drift is measured.
+ *
+ *    clock-sim [--trials N] [--hours N] [--max-ppm N] [--poll-ms 312] [--seed N]
+ *
+ * The SDK's clock ('sntp_get_current_timestamp()') counts true seconds from a random phase.  The
+ * local oscillator ('micros64()') runs fast or slow by a random error of up to '--max-ppm'.  As
+ * in 'loop()', 'poll()' is called every '--poll-ms' (with 0.3 ms of jitter), and once per polling
+ * period after up to 0.5 s spent logging.  Each 'micros64()' call takes 3 us, and each 'yield()'
+ * 20 us.
+ *
+ * Prints one line per trial and a summary.  The clock error is measured once the clock is valid,
+ * so it includes the uncorrected drift until the first resync measures it (e.g., 60 ppm over
+ * 30 minutes is 108 ms.)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include "HostArduino.h"
+#include "../firmware/Clock.h"
+
+namespace {
+  struct Options {
+    int trials = 20;
+    double hours = 3;
+    double maxPpm = 60;
+    double pollMs = 5000 / 16;
+    uint32_t seed = 1;
+  };
+
+  const uint32_t _first_ntp_seconds = 1500000000;
+
+  // The simulated time, in true (NTP) microseconds.
+  double _true_us = 0;
+
+  // Local oscillator error (parts per million), and the true time at which the SDK's clock reads
+  // '_first_ntp_seconds' (i.e., the SNTP client's first response.)
+  double _ppm = 0;
+  double _ntp_start_us = 0;
+
+  // Local microseconds at true time '_true_us'.
+  uint64_t localUs() {
+    return static_cast<uint64_t>(_true_us * (1 + _ppm * 1e-6));
+  }
+
+  // True UTC milliseconds at the current time (for comparison with 'Clock::nowMillis()'.)
+  double trueMillis() {
+    return static_cast<double>(_first_ntp_seconds) * 1000 + (_true_us - _ntp_start_us) / 1000;
+  }
+}
+
+uint64_t micros64() {
+  _true_us += 3;
+  return localUs();
+}
+
+void yield() {
+  _true_us += 20;
+}
+
+uint32_t sntp_get_current_timestamp() {
+  return _true_us < _ntp_start_us
+    ? 0
+    : _first_ntp_seconds + static_cast<uint32_t>((_true_us - _ntp_start_us) / 1e6);
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--trials") == 0)         { options.trials = atoi(argv[i + 1]); }
+    else if (strcmp(argv[i], "--hours") == 0)     { options.hours = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--max-ppm") == 0)   { options.maxPpm = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--poll-ms") == 0)   { options.pollMs = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--seed") == 0)      { options.seed = strtoul(argv[i + 1], nullptr, 10); }
+    else {
+      fprintf(stderr, "usage: clock-sim [--trials N] [--hours N] [--max-ppm N] [--poll-ms N] [--seed N]\n");
+      return 2;
+    }
+  }
+
+  std::mt19937 random(options.seed);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<double> jitter(0, 300);
+
+  double worstFirstS = 0, worstPollMs = 0, worstErrorMs = 0, worstDriftErrorPpm = 0;
+  for (int trial = 0; trial < options.trials; trial++) {
+    _true_us = 0;
+    _ppm = options.maxPpm * (2 * uniform(random) - 1);
+    _ntp_start_us = 2e6 + uniform(random) * 1e6;
+
+    Clock clock;
+    clock.init(0);
+
+    double firstS = -1, pollMs = 0, errorMs = 0;
+    const int pollsPerPeriod = 16;
+    long polls = static_cast<long>(options.hours * 3600 * 1000 / options.pollMs);
+    for (long i = 0; i < polls; i++) {
+      _true_us += options.pollMs * 1000 + jitter(random);
+      if (i % pollsPerPeriod == pollsPerPeriod - 1) {
+        _true_us += uniform(random) * 500 * 1000;
+      }
+
+      double before = _true_us;
+      clock.poll();
+      pollMs = std::max(pollMs, (_true_us - before) / 1000);
+
+      if (clock.isValid()) {
+        if (firstS < 0) {
+          firstS = (_true_us - _ntp_start_us) / 1e6;
+        }
+        double now = trueMillis();
+        errorMs = std::max(errorMs, fabs(static_cast<double>(clock.nowMillis()) - now));
+      }
+    }
+
+    // 'getDriftPpb()' is (NTP rate - local rate) / local rate.
+    double trueDriftPpm = (1 / (1 + _ppm * 1e-6) - 1) * 1e6;
+    double driftErrorPpm = fabs(clock.getDriftPpb() / 1000.0 - trueDriftPpm);
+    printf("trial %2d: oscillator %+6.1f ppm, first anchor %5.1f s after SNTP, longest poll %5.1f ms, max error %5.2f ms, drift error %.2f ppm\n",
+      trial, _ppm, firstS, pollMs, errorMs, driftErrorPpm);
+
+    worstFirstS = firstS < 0 ? INFINITY : std::max(worstFirstS, firstS);
+    worstPollMs = std::max(worstPollMs, pollMs);
+    worstErrorMs = std::max(worstErrorMs, errorMs);
+    worstDriftErrorPpm = std::max(worstDriftErrorPpm, driftErrorPpm);
+  }
+
+  printf("worst: first anchor %.1f s, longest poll %.1f ms, max error %.2f ms, drift error %.2f ppm\n",
+    worstFirstS, worstPollMs, worstErrorMs, worstDriftErrorPpm);
+  return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * config-snapshot-stress - Checks that readers of firmware/ConfigSnapshot.h never accept a
+ * snapshot that is being rebuilt.
+ *
+ *    config-snapshot-stress [--publishes N] [--readers N] [--spin N]
+ *
+ * One thread publishes three configs in turn as fast as it can while reader threads hold a
+ * snapshot across publishes (as an interrupt handler might), reading its fields '--spin' busy
+ * loop iterations apart.  Each read is classified by whether the fields all belong to one of the
+ * published configs ("consistent") and whether 'ConfigStore::isUnchanged()' accepted it.  An
+ * accepted inconsistent read is a failure (exit status 1.)  Inconsistent reads that were
+ * rejected show that the test does catch snapshots mid-rebuild.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "HostArduino.h"
+#include "../firmware/ConfigSnapshot.h"
+
+namespace {
+  struct Options {
+    long publishes = 2000000;
+    int readers = 2;
+    int spin = 200;
+  };
+
+  // The values a reader copies out of a snapshot.
+  struct Fields {
+    uint32_t generation;
+    float minTOn;
+    double control[4];
+    SafetyThresholds safety;
+  };
+
+  struct Counts {
+    long accepted = 0;
+    long rejected = 0;
+    long acceptedInconsistent = 0;      // Failures.
+    long rejectedInconsistent = 0;
+  };
+
+  Config makeConfig(const char* minTOn, const char* maxTOn, const char* deltaTOn, const char* deltaTOff) {
+    Config config;
+    uint8_t changed = 0;
+    config.set(MIN_T_ON, minTOn, changed);
+    config.set(MAX_T_ON, maxTOn, changed);
+    config.set(DELTA_T_ON, deltaTOn, changed);
+    config.set(DELTA_T_OFF, deltaTOff, changed);
+    return config;
+  }
+
+  // True if 'fields' all came from a snapshot of 'config'.  (The generation identifies which
+  // config was published.)
+  bool matches(const Fields& fields, const Config& config, const SafetyThresholds& safety) {
+    return fields.minTOn == config.getFloat(MIN_T_ON)
+      && fields.control[0] == config.getFloat(MIN_T_ON)
+      && fields.control[1] == config.getFloat(MAX_T_ON)
+      && fields.control[2] == config.getFloat(DELTA_T_ON)
+      && fields.control[3] == config.getFloat(DELTA_T_OFF)
+      && fields.safety.hotBelow == safety.hotBelow
+      && fields.safety.coldAbove == safety.coldAbove;
+  }
+
+  void spin(int iterations) {
+    for (volatile int i = 0; i < iterations; i++) { }
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--publishes") == 0)      { options.publishes = atol(argv[i + 1]); }
+    else if (strcmp(argv[i], "--readers") == 0)   { options.readers = atoi(argv[i + 1]); }
+    else if (strcmp(argv[i], "--spin") == 0)      { options.spin = atoi(argv[i + 1]); }
+    else {
+      fprintf(stderr, "usage: config-snapshot-stress [--publishes N] [--readers N] [--spin N]\n");
+      return 2;
+    }
+  }
+
+  // Generation 'g' publishes 'configs[g % 3]'.  (With 2 configs, each of the double buffer's
+  // halves would always hold the same one, hiding a torn read.)
+  static ConfigStore store;
+  const Config configs[3] = {
+    makeConfig("15", "40", "15", "5"), makeConfig("5", "30", "5", "-5"), makeConfig("10", "35", "10", "0"),
+  };
+  SafetyThresholds safety[3];
+  for (int i = 0; i < 3; i++) {
+    Thermistor thermistor;
+    thermistor.init(configs[i].getFloat(SERIES_RESISTOR), configs[i].getFloat(RESISTANCE_AT_0),
+      configs[i].getFloat(TEMPERATURE_AT_0), configs[i].getFloat(B_COEFFICIENT));
+    safety[i] = SafetyCutoff::computeThresholds(thermistor, configs[i].getFloat(MIN_T_ON), configs[i].getFloat(MAX_T_ON));
+  }
+  store.publish(configs[(store.current().generation + 1) % 3]);
+
+  std::atomic<bool> stop(false);
+  std::vector<Counts> counts(options.readers);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < options.readers; r++) {
+    readers.emplace_back([&, r]() {
+      Counts& mine = counts[r];
+      while (!stop.load(std::memory_order_relaxed)) {
+        const ConfigSnapshot& snapshot = store.current();
+        uint32_t sequence = ConfigStore::beginRead(snapshot);
+
+        Fields fields;
+        fields.generation = snapshot.generation;
+        fields.minTOn = snapshot.config.getFloat(MIN_T_ON);
+        spin(options.spin);
+        fields.control[0] = snapshot.control.minTOn;
+        fields.control[1] = snapshot.control.maxTOn;
+        spin(options.spin);
+        fields.control[2] = snapshot.control.deltaTOn;
+        fields.control[3] = snapshot.control.deltaTOff;
+        fields.safety = snapshot.safety;
+
+        bool accepted = ConfigStore::isUnchanged(snapshot, sequence);
+        bool consistent = matches(fields, configs[fields.generation % 3], safety[fields.generation % 3]);
+        mine.accepted += accepted ? 1 : 0;
+        mine.rejected += accepted ? 0 : 1;
+        mine.acceptedInconsistent += accepted && !consistent ? 1 : 0;
+        mine.rejectedInconsistent += !accepted && !consistent ? 1 : 0;
+      }
+    });
+  }
+
+  for (long i = 0; i < options.publishes; i++) {
+    store.publish(configs[(store.current().generation + 1) % 3]);
+  }
+  stop = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+
+  Counts total;
+  for (const Counts& c : counts) {
+    total.accepted += c.accepted;
+    total.rejected += c.rejected;
+    total.acceptedInconsistent += c.acceptedInconsistent;
+    total.rejectedInconsistent += c.rejectedInconsistent;
+  }
+
+  printf("publishes:                %ld (generation %u)\n", options.publishes, store.current().generation);
+  printf("reads accepted:           %ld (%ld inconsistent)\n", total.accepted, total.acceptedInconsistent);
+  printf("reads rejected (retried): %ld (%ld inconsistent)\n", total.rejected, total.rejectedInconsistent);
+  return total.acceptedInconsistent == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+/*
+ * connectivity-sim - Exercises firmware/Connectivity.h against a simulated flapping WiFi link
+ * and Firebase outages.
+ *
+ *    connectivity-sim [--days N] [--seed N] [--mean-up-s N] [--mean-down-s N] [--mean-cloud-outage-s N]
+ *
+ * The simulated access point alternates between up and down periods (exponentially
+ * distributed.)  A connection attempt succeeds a few seconds after it is started if the access
+ * point is up at that time.  Firebase has independent outages during which log requests fail
+ * while the link stays up.  The control loop "runs" every 5 seconds throughout; the simulator
+ * checks that it is never blocked and reports how quickly connectivity recovers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "../firmware/Connectivity.h"
+
+namespace {
+  struct Options {
+    double days = 7;
+    uint32_t seed = 1;
+    double meanUpS = 2 * 60 * 60;
+    double meanDownS = 90;
+    double meanCloudUpS = 12 * 60 * 60;
+    double meanCloudOutageS = 10 * 60;
+  };
+
+  const uint32_t _tick_ms = 100;            // Resolution of the simulation.
+  const uint32_t _poll_ms = 5000 / 16;      // 'loop()' polls connectivity once per oversample.
+  const uint32_t _log_ms = 5000;            // 'pollingMilliseconds'
+  const uint32_t _connect_ms = 3000;        // Time for a successful association + DHCP.
+
+  // Alternating up/down periods with exponentially distributed lengths.
+  class Flapper {
+    private:
+      std::mt19937& _random;
+      std::exponential_distribution<double> _up;
+      std::exponential_distribution<double> _down;
+      bool _is_up = true;
+      uint64_t _until_ms;
+
+    public:
+      Flapper(std::mt19937& random, double meanUpS, double meanDownS)
+        : _random(random), _up(1.0 / (meanUpS * 1000)), _down(1.0 / (meanDownS * 1000)) {
+        _until_ms = static_cast<uint64_t>(_up(_random));
+      }
+
+      // Returns true if the state changed.
+      bool advance(uint64_t now) {
+        if (now < _until_ms) {
+          return false;
+        }
+        _is_up = !_is_up;
+        _until_ms = now + 1 + static_cast<uint64_t>(_is_up ? _up(_random) : _down(_random));
+        return true;
+      }
+
+      bool isUp() const { return _is_up; }
+  };
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--days") == 0)                     { options.days = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--seed") == 0)                { options.seed = strtoul(argv[i + 1], nullptr, 10); }
+    else if (strcmp(argv[i], "--mean-up-s") == 0)           { options.meanUpS = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--mean-down-s") == 0)         { options.meanDownS = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--mean-cloud-outage-s") == 0) { options.meanCloudOutageS = atof(argv[i + 1]); }
+    else {
+      fprintf(stderr, "usage: connectivity-sim [--days N] [--seed N] [--mean-up-s N] [--mean-down-s N] [--mean-cloud-outage-s N]\n");
+      return 2;
+    }
+  }
+
+  std::mt19937 random(options.seed);
+  Flapper accessPoint(random, options.meanUpS, options.meanDownS);
+  Flapper firebase(random, options.meanCloudUpS, options.meanCloudOutageS);
+  Connectivity connectivity(options.seed * 2654435761u + 1);
+
+  bool linkUp = true;
+  uint64_t connectingUntil = 0;             // Non-zero while a simulated attempt is in flight.
+  bool attemptWillSucceed = false;
+
+  uint64_t apDowntimeMs = 0;
+  uint64_t apUpSince = 0;                   // When the access point last came back (0 = never went down.)
+  bool awaitingRecovery = false;
+  std::vector<double> recoveryS;            // Access point back -> 'isOnline()'.
+
+  uint64_t loops = 0, logsAttempted = 0, logsSucceeded = 0;
+  uint64_t end = static_cast<uint64_t>(options.days * 24 * 60 * 60 * 1000);
+
+  for (uint64_t now = 0; now < end; now += _tick_ms) {
+    firebase.advance(now);
+    if (accessPoint.advance(now)) {
+      if (!accessPoint.isUp()) {
+        linkUp = false;
+        connectingUntil = 0;
+      } else {
+        apUpSince = now;
+        awaitingRecovery = true;
+      }
+    }
+    apDowntimeMs += accessPoint.isUp() ? 0 : _tick_ms;
+
+    if (connectingUntil != 0 && now >= connectingUntil) {
+      linkUp = attemptWillSucceed && accessPoint.isUp();
+      connectingUntil = 0;
+    }
+
+    // 'millis()' on the device is 32 bits; exercise the wrap by offsetting the simulated clock.
+    uint32_t millis = static_cast<uint32_t>(now) + 0xFFF00000u;
+
+    if (now % _poll_ms < _tick_ms) {
+      Connectivity::Action action = connectivity.poll(millis, linkUp);
+      if (action != Connectivity::NO_ACTION) {
+        if (action == Connectivity::RECONNECT) {
+          linkUp = false;
+        }
+        connectingUntil = now + _connect_ms;
+        attemptWillSucceed = accessPoint.isUp();
+      }
+
+      if (awaitingRecovery && connectivity.isOnline()) {
+        recoveryS.push_back((now - apUpSince) / 1000.0);
+        awaitingRecovery = false;
+      }
+    }
+
+    if (now % _log_ms < _tick_ms) {
+      loops++;
+      if (connectivity.isOnline()) {
+        bool success = linkUp && firebase.isUp();
+        logsAttempted++;
+        logsSucceeded += success ? 1 : 0;
+        connectivity.reportCloudResult(success);
+      }
+    }
+  }
+
+  uint32_t finalMillis = static_cast<uint32_t>(end) + 0xFFF00000u;
+  std::sort(recoveryS.begin(), recoveryS.end());
+  auto percentile = [&recoveryS](double p) {
+    return recoveryS.empty() ? 0.0 : recoveryS[std::min(recoveryS.size() - 1, static_cast<size_t>(p * recoveryS.size()))];
+  };
+
+  printf("simulated:            %.1f days\n", options.days);
+  printf("control loops:        %llu of %llu\n", (unsigned long long)loops, (unsigned long long)(end / _log_ms));
+  printf("access point down:    %.1f min\n", apDowntimeMs / 60000.0);
+  printf("device offline:       %.1f min\n", connectivity.getDowntimeMs(finalMillis) / 60000.0);
+  printf("reconnects:           %u (%u attempts)\n", connectivity.getReconnects(), connectivity.getAttempts());
+  printf("logs:                 %llu of %llu succeeded\n", (unsigned long long)logsSucceeded, (unsigned long long)logsAttempted);
+  printf("recovery after AP up: p50 %.1f s, p95 %.1f s, max %.1f s (%zu outages)\n",
+    percentile(0.5), percentile(0.95), recoveryS.empty() ? 0.0 : recoveryS.back(), recoveryS.size());
+  return 0;
+}
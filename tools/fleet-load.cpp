@@ -0,0 +1,1038 @@
+/*
+ * fleet-load - Emulates a fleet of devices making the firmware's Firebase requests at once, to
+ * see how the backend copes before more pools are added.
+ *
+ *    fleet-load [--devices 1000] [--seconds 60] [--threads N] [--boot-spread-ms 0] [--skew-pct 1]
+ *               [--timeout-ms 5000] [--report-s 10] [--target host:port]
+ *               [--polling-ms 5000] [--max-entries 1000] [--deadband 0] [--heartbeat-ms 300000]
+ *               [--adc-step 0.5] [--server-threads N] [--server-latency-ms 0]
+ *               [--outage start-s:duration-s ...]
+ *
+ * Each virtual device runs firmware.ino's 'loop()' with the firmware's own 'Connectivity.h',
+ * 'UploadFilter.h', 'Config.h' and 'CloudProtocol.h' (built against 'HostArduino.h'): it boots
+ * at a random time within '--boot-spread-ms' (0 = all at once) and polls 'Connectivity' once per
+ * sample ('pollingMilliseconds / oversample'.)  At the end of each polling period it GETs
+ * '/config.json' until it loads (every 30 s, parsed with 'JsonReader.h' as 'CloudStorage' does),
+ * then PUTs the sample to '/log/<n>.json' with up to 3 attempts if 'UploadFilter' passes it.
+ * The thermistor readings are a random walk with steps of '--adc-step' codes per period.  Each
+ * logged record is reported to 'Connectivity', so an outage takes devices offline and they
+ * reconnect with its jittered backoff (a reconnect takes 3 s.)  As on the device, a request
+ * blocks the loop, and each device's clock runs up to '--skew-pct' fast or slow.  Requests that
+ * take longer than '--timeout-ms' fail (as with the device's HTTP client.)
+ *
+ * Devices are divided between '--threads' event loops (epoll, non-blocking sockets, one
+ * keep-alive connection per device.)  Without '--target', requests go to a built-in stand-in
+ * for the Firebase REST API on 127.0.0.1, which serves a config built from '--polling-ms',
+ * '--max-entries', '--deadband' and '--heartbeat-ms', optionally delays responses by
+ * '--server-latency-ms', and stops responding during each '--outage'.
+ *
+ * Reports throughput, attempt latency percentiles, retry amplification (attempts per logged
+ * record), the samples skipped by 'UploadFilter', reconnects and time offline, and a timeline of
+ * each '--report-s' interval.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "HostArduino.h"
+#include "../firmware/CloudProtocol.h"
+#include "../firmware/Config.h"
+#include "../firmware/Connectivity.h"
+#include "../firmware/JsonReader.h"
+#include "../firmware/UploadFilter.h"
+
+namespace {
+  struct Outage {
+    int64_t startUs;
+    int64_t endUs;
+  };
+
+  struct Options {
+    uint32_t devices = 1000;
+    double seconds = 60;
+    unsigned threads = 0;
+    double bootSpreadMs = 0;
+    double skewPct = 1;
+    double timeoutMs = 5000;
+    double reportS = 10;
+    std::string target;
+    uint32_t pollingMs = 5000;
+    uint32_t maxEntries = 1000;
+    double deadband = 0;
+    uint32_t heartbeatMs = 300000;
+    double adcStep = 0.5;
+    unsigned serverThreads = 0;
+    double serverLatencyMs = 0;
+    std::vector<Outage> outages;
+  };
+
+  const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+
+  // Microseconds since the tool started.
+  int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+  }
+
+  bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+      std::string key(argv[i]);
+      const char* value = argv[i + 1];
+      if      (key == "--devices")            { options.devices = atoi(value); }
+      else if (key == "--seconds")            { options.seconds = atof(value); }
+      else if (key == "--threads")            { options.threads = atoi(value); }
+      else if (key == "--boot-spread-ms")     { options.bootSpreadMs = atof(value); }
+      else if (key == "--skew-pct")           { options.skewPct = atof(value); }
+      else if (key == "--timeout-ms")         { options.timeoutMs = atof(value); }
+      else if (key == "--report-s")           { options.reportS = atof(value); }
+      else if (key == "--target")             { options.target = value; }
+      else if (key == "--polling-ms")         { options.pollingMs = atoi(value); }
+      else if (key == "--max-entries")        { options.maxEntries = atoi(value); }
+      else if (key == "--deadband")           { options.deadband = atof(value); }
+      else if (key == "--heartbeat-ms")       { options.heartbeatMs = atoi(value); }
+      else if (key == "--adc-step")           { options.adcStep = atof(value); }
+      else if (key == "--server-threads")     { options.serverThreads = atoi(value); }
+      else if (key == "--server-latency-ms")  { options.serverLatencyMs = atof(value); }
+      else if (key == "--outage") {
+        double start, duration;
+        if (sscanf(value, "%lf:%lf", &start, &duration) != 2) {
+          return false;
+        }
+        options.outages.push_back(Outage { static_cast<int64_t>(start * 1e6), static_cast<int64_t>((start + duration) * 1e6) });
+      }
+      else { return false; }
+    }
+    return (argc % 2) == 1 && options.devices > 0 && options.seconds > 0 && options.reportS > 0;
+  }
+
+  // Finds the end of the HTTP header in 'buffer' and the value of its 'Content-Length' (0 if
+  // absent.)  Returns false if the header is not complete.
+  bool parseHeader(const std::string& buffer, size_t& bodyStart, size_t& contentLength, bool& close) {
+    size_t end = buffer.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      return false;
+    }
+    bodyStart = end + 4;
+    contentLength = 0;
+    close = false;
+
+    for (size_t line = buffer.find("\r\n") + 2; line < end; ) {
+      size_t next = buffer.find("\r\n", line);
+      if (strncasecmp(&buffer[line], "Content-Length:", 15) == 0) {
+        contentLength = strtoul(&buffer[line + 15], nullptr, 10);
+      } else if (strncasecmp(&buffer[line], "Connection:", 11) == 0) {
+        close = buffer.compare(line + 11, next - line - 11, " close") == 0;
+      }
+      line = next + 2;
+    }
+    return true;
+  }
+
+  // One-shot timers for an event loop.  Stale timers are skipped by comparing 'generation'.
+  struct Timer {
+    int64_t atUs;
+    uint32_t index;
+    uint32_t generation;
+
+    bool operator>(const Timer& other) const {
+      return atUs > other.atUs;
+    }
+  };
+  typedef std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> TimerQueue;
+
+  // Milliseconds until the next timer (for 'epoll_wait()'), at most 'maxMs'.
+  int waitMs(const TimerQueue& timers, int maxMs) {
+    if (timers.empty()) {
+      return maxMs;
+    }
+    int64_t us = timers.top().atUs - nowUs();
+    return static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(maxMs, (us + 999) / 1000)));
+  }
+
+  // --- Stand-in server --------------------------------------------------------------------
+
+  // Collects 'Config::printTo()' output.
+  class StringPrint : public Print {
+    private:
+      std::string& _text;
+
+    public:
+      explicit StringPrint(std::string& text) : _text(text) { }
+
+      void write(const char* text) override { _text += text; }
+  };
+
+  // Minimal Firebase REST stand-in: GET '/config.json' returns the config; PUT '/log/...'
+  // echoes the record (as Firebase does.)  Anything else is a 404.
+  class StandInServer {
+    private:
+      struct Connection {
+        int fd;
+        std::string in;
+        std::string out;
+        size_t sent = 0;
+        bool closeAfterWrite = false;
+        uint32_t generation = 0;
+      };
+
+      const Options& _options;
+      std::string _config;
+      uint16_t _port = 0;
+      std::vector<int> _listeners;
+      std::vector<std::thread> _threads;
+      std::atomic<bool> _stopping{false};
+      std::atomic<uint64_t> _requests{0};
+      std::atomic<uint64_t> _dropped{0};
+
+      bool inOutage(int64_t now) const {
+        for (const Outage& outage : _options.outages) {
+          if (now >= outage.startUs && now < outage.endUs) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      void respond(Connection& connection, const char* status, const std::string& body, bool close) {
+        char header[160];
+        snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s\r\n",
+          status, body.size(), close ? "Connection: close\r\n" : "");
+        connection.out += header;
+        connection.out += body;
+        connection.closeAfterWrite |= close;
+      }
+
+      // Consumes complete requests from 'connection.in'.  Returns true if a response is queued.
+      bool handleRequests(Connection& connection) {
+        bool queued = false;
+        size_t bodyStart, contentLength;
+        bool close;
+        while (parseHeader(connection.in, bodyStart, contentLength, close)
+          && connection.in.size() >= bodyStart + contentLength) {
+          std::string line = connection.in.substr(0, connection.in.find("\r\n"));
+          std::string body = connection.in.substr(bodyStart, contentLength);
+          connection.in.erase(0, bodyStart + contentLength);
+          _requests++;
+
+          // During an outage, requests go unanswered (the client times out.)
+          if (inOutage(nowUs())) {
+            _dropped++;
+            continue;
+          }
+
+          if (line.compare(0, 17, "GET /config.json?") == 0 || line.compare(0, 17, "GET /config.json ") == 0) {
+            respond(connection, "200 OK", _config, close);
+          } else if (line.compare(0, 9, "PUT /log/") == 0) {
+            respond(connection, "200 OK", body, close);
+          } else {
+            respond(connection, "404 Not Found", "null", close);
+          }
+          queued = true;
+        }
+        return queued;
+      }
+
+      // Writes as much of 'connection.out' as the socket accepts.  Returns false if the
+      // connection should be closed.
+      bool flush(Connection& connection) {
+        while (connection.sent < connection.out.size()) {
+          ssize_t n = send(connection.fd, connection.out.data() + connection.sent, connection.out.size() - connection.sent, MSG_NOSIGNAL);
+          if (n < 0) {
+            return errno == EAGAIN;
+          }
+          connection.sent += n;
+        }
+        connection.out.clear();
+        connection.sent = 0;
+        return !connection.closeAfterWrite;
+      }
+
+      void run(int listener) {
+        int epoll = epoll_create1(0);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = listener;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+
+        std::unordered_map<int, Connection> connections;
+        TimerQueue delayed;                                 // Responses held for '--server-latency-ms'.
+        int64_t latencyUs = static_cast<int64_t>(_options.serverLatencyMs * 1000);
+
+        auto close = [&](int fd) {
+          epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+          ::close(fd);
+          connections.erase(fd);
+        };
+        auto send = [&](Connection& connection) {
+          if (!flush(connection)) {
+            close(connection.fd);
+            return;
+          }
+          epoll_event update = {};
+          update.events = connection.out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+          update.data.fd = connection.fd;
+          epoll_ctl(epoll, EPOLL_CTL_MOD, connection.fd, &update);
+        };
+
+        std::vector<epoll_event> events(256);
+        while (!_stopping) {
+          int count = epoll_wait(epoll, events.data(), events.size(), waitMs(delayed, 50));
+          for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listener) {
+              int client;
+              while ((client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+                int one = 1;
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                connections[client].fd = client;
+                epoll_event add = {};
+                add.events = EPOLLIN;
+                add.data.fd = client;
+                epoll_ctl(epoll, EPOLL_CTL_ADD, client, &add);
+              }
+              continue;
+            }
+
+            auto found = connections.find(fd);
+            if (found == connections.end()) {
+              continue;
+            }
+            Connection& connection = found->second;
+
+            if (events[i].events & EPOLLOUT) {
+              send(connection);
+              continue;
+            }
+
+            char buffer[4096];
+            ssize_t n;
+            while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+              connection.in.append(buffer, n);
+            }
+            if (n == 0 || (n < 0 && errno != EAGAIN)) {
+              close(fd);
+              continue;
+            }
+
+            if (handleRequests(connection)) {
+              if (latencyUs > 0) {
+                delayed.push(Timer { nowUs() + latencyUs, static_cast<uint32_t>(fd), ++connection.generation });
+              } else {
+                send(connection);
+              }
+            }
+          }
+
+          while (!delayed.empty() && delayed.top().atUs <= nowUs()) {
+            Timer timer = delayed.top();
+            delayed.pop();
+            auto found = connections.find(timer.index);
+            if (found != connections.end() && found->second.generation == timer.generation) {
+              send(found->second);
+            }
+          }
+        }
+
+        for (auto& entry : connections) {
+          ::close(entry.first);
+        }
+        ::close(epoll);
+      }
+
+    public:
+      explicit StandInServer(const Options& options) : _options(options) {
+        Config config;
+        uint8_t changed = 0;
+        config.set(POLLING_MILLISECONDS, std::to_string(options.pollingMs).c_str(), changed);
+        config.set(MAX_ENTRIES, std::to_string(options.maxEntries).c_str(), changed);
+        config.set(UPLOAD_DEADBAND, std::to_string(options.deadband).c_str(), changed);
+        config.set(HEARTBEAT_MILLISECONDS, std::to_string(options.heartbeatMs).c_str(), changed);
+        StringPrint out(_config);
+        config.printTo(out);
+      }
+
+      ~StandInServer() {
+        _stopping = true;
+        for (std::thread& thread : _threads) {
+          thread.join();
+        }
+        for (int listener : _listeners) {
+          ::close(listener);
+        }
+      }
+
+      // Starts 'threads' event loops, each with its own listening socket on a shared port.
+      bool start(unsigned threads) {
+        for (unsigned i = 0; i < threads; i++) {
+          int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+          int one = 1;
+          setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+          setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+          sockaddr_in address = {};
+          address.sin_family = AF_INET;
+          address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+          address.sin_port = htons(_port);
+          socklen_t length = sizeof(address);
+          if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listener, SOMAXCONN) != 0
+            || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            perror("stand-in server");
+            ::close(listener);
+            return false;
+          }
+          _port = ntohs(address.sin_port);
+          _listeners.push_back(listener);
+        }
+
+        for (int listener : _listeners) {
+          _threads.emplace_back(&StandInServer::run, this, listener);
+        }
+        return true;
+      }
+
+      uint16_t getPort() const          { return _port; }
+      uint64_t getRequests() const      { return _requests; }
+      uint64_t getDropped() const       { return _dropped; }
+  };
+
+  // --- Virtual devices --------------------------------------------------------------------
+
+  typedef enum : uint8_t {
+    GET_CONFIG = 0,
+    SET_LOG,
+  } RequestKind;
+
+  // One completed request attempt.
+  struct Attempt {
+    int64_t startUs;
+    uint32_t latencyUs;
+    RequestKind kind;
+    bool success;
+    bool timedOut;
+  };
+
+  struct FleetStats {
+    std::vector<Attempt> attempts;
+    std::vector<uint32_t> configLoadUs;   // Per device: boot to config loaded.
+    uint64_t writes = 0;                  // Log records finished (successfully or not.)
+    uint64_t failedWrites = 0;            // Log records that failed every attempt.
+    uint32_t configLoaded = 0;
+    uint64_t samples = 0;                 // End of period samples taken while online with a config.
+    uint64_t skipped = 0;                 // ... of which 'UploadFilter' skipped.
+    uint64_t reconnects = 0;              // 'Connectivity' recoveries, over all devices.
+    uint64_t offlineMs = 0;               // Device time spent offline, over all devices.
+
+    void merge(const FleetStats& other) {
+      attempts.insert(attempts.end(), other.attempts.begin(), other.attempts.end());
+      configLoadUs.insert(configLoadUs.end(), other.configLoadUs.begin(), other.configLoadUs.end());
+      writes += other.writes;
+      failedWrites += other.failedWrites;
+      configLoaded += other.configLoaded;
+      samples += other.samples;
+      skipped += other.skipped;
+      reconnects += other.reconnects;
+      offlineMs += other.offlineMs;
+    }
+  };
+
+  // Parses the config body into 'config' as 'CloudStorage::parseConfig()' does: unknown keys
+  // are skipped, and missing 'CONFIG_OPTIONAL' settings take their built-in defaults.
+  class StringSource {
+    private:
+      const std::string& _text;
+      size_t _position = 0;
+
+    public:
+      explicit StringSource(const std::string& text) : _text(text) { }
+
+      int read() {
+        return _position < _text.size() ? static_cast<uint8_t>(_text[_position++]) : -1;
+      }
+  };
+
+  bool parseConfig(const std::string& body, Config& config) {
+    StringSource source(body);
+    JsonReader<StringSource> reader(source);
+    if (reader.next() != JSON_BEGIN_OBJECT) {
+      return false;
+    }
+
+    bool success = true;
+    uint32_t seen = 0;
+    uint8_t changed = 0;
+    JsonToken token;
+    while ((token = reader.next()) == JSON_KEY) {
+      ConfigKey key = Config::find(reader.text());
+      token = reader.next();
+      if (key == CONFIG_KEY_COUNT) {
+        success &= reader.skipValue(token);
+        continue;
+      }
+
+      seen |= 1UL << key;
+      if ((token != JSON_NUMBER && token != JSON_STRING) || reader.isTruncated()) {
+        reader.skipValue(token);
+        success = false;
+        continue;
+      }
+      success &= config.set(key, reader.text(), changed);
+    }
+    if (token != JSON_END_OBJECT) {
+      return false;
+    }
+
+    for (uint8_t i = 0; i < CONFIG_KEY_COUNT; i++) {
+      if ((seen & (1UL << i)) != 0) {
+        continue;
+      }
+
+      ConfigKey key = static_cast<ConfigKey>(i);
+      ConfigDescriptor descriptor = Config::describe(key);
+      if (descriptor.presence == CONFIG_REQUIRED) {
+        success = false;
+        continue;
+      }
+      config.set(key, descriptor.defaultValue, changed);
+    }
+    return success;
+  }
+
+  // Each device runs firmware.ino's 'loop()': every 'pollingMilliseconds / oversample' it takes a
+  // sample and polls 'Connectivity'; at the end of each polling period it loads the config (if
+  // not yet loaded) or, if 'UploadFilter' passes the sample, logs it following 'CloudProtocol'.
+  // While a request is in flight the device is blocked, as 'loop()' is.
+  class DeviceLoop {
+    private:
+      typedef enum : uint8_t {
+        IDLE = 0,             // Waiting for the timer to take the next sample.
+        RETRY_DELAY,          // Waiting '_attempt_delay_ms' to attempt the log write again.
+        CONNECTING,
+        SENDING,
+        RECEIVING,
+      } IoState;
+
+      static const uint32_t _connect_ms = 3000;     // Time to reassociate after a 'Connectivity' action.
+
+      struct Device {
+        CloudProtocol protocol;
+        Connectivity connectivity;
+        UploadFilter filter;
+        Config config;                    // Built-in defaults until the config GET succeeds.
+        bool configLoaded = false;
+        int64_t nextConfigAttemptUs = 0;
+        double rate;                      // Clock rate (1 +/- skew.)
+        int64_t bootUs;
+
+        int sample = 0;                   // Samples taken in the current polling period.
+        double adc[2];                    // Random walk standing in for the thermistors.
+        bool active;
+        bool linkUp = true;
+        int64_t linkUpAtUs = -1;          // When the current (re)association completes, if any.
+
+        int fd = -1;
+        IoState io = IDLE;
+        RequestKind kind;
+        std::string out;
+        size_t sent = 0;
+        std::string in;
+        int64_t requestStartUs;
+        uint32_t generation = 0;
+      };
+
+      const Options& _options;
+      sockaddr_in _address;
+      std::vector<Device> _devices;
+      int _epoll;
+      TimerQueue _timers;
+      FleetStats _stats;
+      std::mt19937_64 _random;
+      std::normal_distribution<double> _adc_step;
+
+      void arm(uint32_t index, int64_t atUs) {
+        _timers.push(Timer { atUs, index, ++_devices[index].generation });
+      }
+
+      // The device's 'millis()' at 'now'.
+      static uint32_t millisOf(const Device& device, int64_t now) {
+        return static_cast<uint32_t>((now - device.bootUs) / device.rate / 1000);
+      }
+
+      // Microseconds of tool time for 'ms' of device time.
+      static int64_t toUs(const Device& device, double ms) {
+        return static_cast<int64_t>(ms * 1000 * device.rate);
+      }
+
+      // 'duration' in 'loop()'.
+      static int64_t sampleUs(const Device& device) {
+        return toUs(device, device.config.getInt(POLLING_MILLISECONDS) / device.config.getInt(OVERSAMPLE));
+      }
+
+      void watch(uint32_t index, uint32_t events) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.u32 = index;
+        epoll_ctl(_epoll, EPOLL_CTL_MOD, _devices[index].fd, &event);
+      }
+
+      void closeConnection(Device& device) {
+        if (device.fd >= 0) {
+          epoll_ctl(_epoll, EPOLL_CTL_DEL, device.fd, nullptr);
+          close(device.fd);
+          device.fd = -1;
+        }
+      }
+
+      // One iteration of the sampling loop in 'loop()'.
+      void takeSample(uint32_t index, int64_t now) {
+        Device& device = _devices[index];
+
+        // 'maintainConnectivity()'.  Carrying out an action ('Network::apply()') drops the
+        // connection; the link comes back '_connect_ms' later.
+        if (device.linkUpAtUs >= 0 && now >= device.linkUpAtUs) {
+          device.linkUp = true;
+          device.linkUpAtUs = -1;
+        }
+        if (device.connectivity.poll(millisOf(device, now), device.linkUp) != Connectivity::NO_ACTION) {
+          closeConnection(device);
+          device.linkUp = false;
+          device.linkUpAtUs = now + toUs(device, _connect_ms);
+        }
+
+        if (++device.sample < device.config.getInt(OVERSAMPLE)) {
+          arm(index, now + sampleUs(device));
+          return;
+        }
+        device.sample = 0;
+        device.adc[0] += _adc_step(_random);
+        device.adc[1] += _adc_step(_random);
+
+        // 'maybeLoadConfig()', then log (if the config is loaded.)
+        if (!device.configLoaded) {
+          if (device.connectivity.isOnline() && now >= device.nextConfigAttemptUs) {
+            startRequest(index, GET_CONFIG, now);
+            return;
+          }
+        } else if (maybeLog(index, now)) {
+          return;
+        }
+        arm(index, now + sampleUs(device));
+      }
+
+      // Starts logging the sample at the end of a polling period, if we're online and
+      // 'UploadFilter' passes it.  Returns false (leaving the device idle) otherwise.
+      bool maybeLog(uint32_t index, int64_t now) {
+        Device& device = _devices[index];
+        if (!device.connectivity.isOnline()) {
+          return false;
+        }
+
+        _stats.samples++;
+        if (!device.filter.shouldUpload(millisOf(device, now), device.adc[0], device.adc[1], device.active,
+              device.config.getFloat(UPLOAD_DEADBAND), device.config.getInt(HEARTBEAT_MILLISECONDS))) {
+          _stats.skipped++;
+          return false;
+        }
+        startRequest(index, SET_LOG, now);
+        return true;
+      }
+
+      // Builds the request (as 'CloudStorage' would) and starts sending it.
+      void startRequest(uint32_t index, RequestKind kind, int64_t now) {
+        Device& device = _devices[index];
+        char request[512];
+        device.kind = kind;
+        if (kind == GET_CONFIG) {
+          // 'CloudStorage::update()' does not reuse its connection.
+          snprintf(request, sizeof(request), "GET /%s.json?auth=fleet-load HTTP/1.1\r\nHost: stand-in\r\nConnection: close\r\n\r\n",
+            CloudProtocol::configRef());
+        } else {
+          char ref[24];
+          CloudProtocol::formatEntryRef(ref, sizeof(ref), device.protocol.getEntry());
+          char body[256];
+          int length = snprintf(body, sizeof(body),
+            "{\"0\":%.2f,\"1\":%.2f,\"active\":%s,\"skipped\":%u,\"rate0\":0.12,\"rate1\":1.5,\"noise0\":0.02,\"noise1\":0.03,\"time\":%lld}",
+            device.adc[0], device.adc[1], device.active ? "true" : "false", device.filter.getSkipped(),
+            1700000000000LL + now / 1000);
+          snprintf(request, sizeof(request), "PUT /%s.json?auth=fleet-load HTTP/1.1\r\nHost: stand-in\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%s",
+            ref, length, body);
+        }
+        device.out = request;
+        device.sent = 0;
+        device.in.clear();
+        device.requestStartUs = now;
+        arm(index, now + static_cast<int64_t>(_options.timeoutMs * 1000));
+
+        if (device.fd >= 0) {
+          device.io = SENDING;
+          send(index);
+          return;
+        }
+
+        device.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int one = 1;
+        setsockopt(device.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (device.fd < 0
+          || (connect(device.fd, reinterpret_cast<const sockaddr*>(&_address), sizeof(_address)) != 0 && errno != EINPROGRESS)) {
+          finish(index, false, false);
+          return;
+        }
+
+        epoll_event event = {};
+        event.events = EPOLLOUT;
+        event.data.u32 = index;
+        epoll_ctl(_epoll, EPOLL_CTL_ADD, device.fd, &event);
+        device.io = CONNECTING;
+      }
+
+      void send(uint32_t index) {
+        Device& device = _devices[index];
+        while (device.sent < device.out.size()) {
+          ssize_t n = ::send(device.fd, device.out.data() + device.sent, device.out.size() - device.sent, MSG_NOSIGNAL);
+          if (n < 0) {
+            if (errno == EAGAIN) {
+              watch(index, EPOLLOUT);
+              return;
+            }
+            finish(index, false, false);
+            return;
+          }
+          device.sent += n;
+        }
+        device.io = RECEIVING;
+        watch(index, EPOLLIN | EPOLLRDHUP);
+      }
+
+      void receive(uint32_t index) {
+        Device& device = _devices[index];
+        char buffer[4096];
+        ssize_t n;
+        while ((n = recv(device.fd, buffer, sizeof(buffer), 0)) > 0) {
+          device.in.append(buffer, n);
+        }
+        bool closed = n == 0 || (n < 0 && errno != EAGAIN);
+
+        size_t bodyStart, contentLength;
+        bool close;
+        if (parseHeader(device.in, bodyStart, contentLength, close) && device.in.size() >= bodyStart + contentLength) {
+          bool success = device.in.compare(0, 12, "HTTP/1.1 200") == 0;
+          if (success && device.kind == GET_CONFIG) {
+            // As in 'CloudStorage::update()', settings parsed before a failure are kept.
+            success = parseConfig(device.in.substr(bodyStart, contentLength), device.config);
+          }
+          if (close || closed) {
+            closeConnection(device);
+          }
+          finish(index, success, false);
+        } else if (closed) {
+          finish(index, false, false);
+        }
+      }
+
+      // Records the attempt and continues the device's 'loop()'.
+      void finish(uint32_t index, bool success, bool timedOut) {
+        Device& device = _devices[index];
+        int64_t now = nowUs();
+        _stats.attempts.push_back(Attempt {
+          device.requestStartUs, static_cast<uint32_t>(now - device.requestStartUs), device.kind, success, timedOut });
+
+        if (!success) {
+          closeConnection(device);
+        } else if (device.fd >= 0) {
+          watch(index, EPOLLRDHUP);         // Notice if the server drops the idle connection.
+        }
+        device.io = IDLE;
+
+        if (device.kind == GET_CONFIG) {
+          if (success) {
+            device.configLoaded = true;
+            _stats.configLoaded++;
+            _stats.configLoadUs.push_back(static_cast<uint32_t>(now - device.bootUs));
+            if (maybeLog(index, now)) {
+              return;                       // 'loop()' logs in the iteration that loaded the config.
+            }
+          } else {
+            device.nextConfigAttemptUs = now + toUs(device, CloudProtocol::_config_retry_ms);
+          }
+          arm(index, now + sampleUs(device));
+          return;
+        }
+
+        // 'CloudStorage::log()' pauses after every attempt, including the last.
+        int64_t attemptDelayUs = toUs(device, CloudProtocol::_attempt_delay_ms);
+        if (device.protocol.completeAttempt(success, device.config.getInt(MAX_ENTRIES))) {
+          device.io = RETRY_DELAY;
+          arm(index, now + attemptDelayUs);
+          return;
+        }
+        _stats.writes++;
+        _stats.failedWrites += success ? 0 : 1;
+        device.connectivity.reportCloudResult(success);
+        if (success) {
+          device.filter.uploaded(millisOf(device, now), device.adc[0], device.adc[1], device.active);
+        }
+        arm(index, now + attemptDelayUs + sampleUs(device));
+      }
+
+    public:
+      DeviceLoop(const Options& options, const sockaddr_in& address, uint32_t count, uint64_t seed)
+        : _options(options), _address(address), _devices(count), _epoll(epoll_create1(0)),
+          _random(seed), _adc_step(0, options.adcStep) {
+        std::uniform_real_distribution<double> uniform(0, 1);
+        for (uint32_t i = 0; i < count; i++) {
+          Device& device = _devices[i];
+          device.connectivity = Connectivity(static_cast<uint32_t>(seed * 100003 + i + 1));
+          device.rate = 1 + (uniform(_random) * 2 - 1) * options.skewPct / 100;
+          device.bootUs = static_cast<int64_t>(uniform(_random) * options.bootSpreadMs * 1000);
+          device.adc[0] = 512 + (i % 97) / 4.0;
+          device.adc[1] = 480 + (i % 89) / 4.0;
+          device.active = (i & 1) != 0;
+          device.connectivity.init(0, true);
+          arm(i, device.bootUs);
+        }
+      }
+
+      ~DeviceLoop() {
+        for (Device& device : _devices) {
+          closeConnection(device);
+        }
+        close(_epoll);
+      }
+
+      void run(int64_t endUs) {
+        std::vector<epoll_event> events(256);
+        while (nowUs() < endUs) {
+          int count = epoll_wait(_epoll, events.data(), events.size(), waitMs(_timers, 50));
+          for (int i = 0; i < count; i++) {
+            uint32_t index = events[i].data.u32;
+            Device& device = _devices[index];
+            switch (device.io) {
+              case IDLE:
+              case RETRY_DELAY:
+                closeConnection(device);        // The server closed the kept-alive connection.
+                break;
+              case CONNECTING: {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(device.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                if (error != 0) {
+                  finish(index, false, false);
+                  break;
+                }
+                device.io = SENDING;
+                send(index);
+                break;
+              }
+              case SENDING:
+                send(index);
+                break;
+              case RECEIVING:
+                receive(index);
+                break;
+            }
+          }
+
+          int64_t now = nowUs();
+          while (!_timers.empty() && _timers.top().atUs <= now) {
+            Timer timer = _timers.top();
+            _timers.pop();
+            Device& device = _devices[timer.index];
+            if (timer.generation != device.generation) {
+              continue;
+            }
+            if (device.io == IDLE) {
+              takeSample(timer.index, now);
+            } else if (device.io == RETRY_DELAY) {
+              device.io = IDLE;
+              startRequest(timer.index, SET_LOG, now);
+            } else {
+              finish(timer.index, false, true);   // Timed out.
+            }
+          }
+        }
+
+        int64_t now = nowUs();
+        for (Device& device : _devices) {
+          _stats.reconnects += device.connectivity.getReconnects();
+          _stats.offlineMs += device.connectivity.getDowntimeMs(millisOf(device, now));
+        }
+      }
+
+      const FleetStats& getStats() const {
+        return _stats;
+      }
+  };
+
+  // --- Report -----------------------------------------------------------------------------
+
+  double percentileMs(std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+      return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))] / 1000.0;
+  }
+
+  void printLatencies(const char* name, std::vector<uint32_t> latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-9s p50 %8.2f ms  p99 %8.2f ms  p99.9 %8.2f ms  max %8.2f ms\n", name,
+      percentileMs(latencies, 0.5), percentileMs(latencies, 0.99), percentileMs(latencies, 0.999), percentileMs(latencies, 1));
+  }
+
+  void report(const Options& options, const FleetStats& stats, double seconds) {
+    uint64_t logAttempts = 0, logSuccesses = 0, configAttempts = 0, timeouts = 0, errors = 0;
+    std::vector<uint32_t> logLatencies;
+    for (const Attempt& attempt : stats.attempts) {
+      if (attempt.kind == SET_LOG) {
+        logAttempts++;
+        logSuccesses += attempt.success ? 1 : 0;
+        if (attempt.success) {
+          logLatencies.push_back(attempt.latencyUs);
+        }
+      } else {
+        configAttempts++;
+      }
+      timeouts += attempt.timedOut ? 1 : 0;
+      errors += !attempt.success && !attempt.timedOut ? 1 : 0;
+    }
+
+    printf("%u devices, %.0f s, polling %u ms (+/- %.1f%%), boot spread %.0f ms, timeout %.0f ms\n",
+      options.devices, seconds, options.pollingMs, options.skewPct, options.bootSpreadMs, options.timeoutMs);
+    printf("config:   %u/%u devices loaded, %llu attempts\n", stats.configLoaded, options.devices,
+      static_cast<unsigned long long>(configAttempts));
+    std::vector<uint32_t> configLoad = stats.configLoadUs;
+    printLatencies("  boot to config", configLoad);
+    printf("log:      %llu records, %llu failed all %u attempts, %llu attempts (retry amplification %.3fx)\n",
+      static_cast<unsigned long long>(stats.writes), static_cast<unsigned long long>(stats.failedWrites),
+      CloudProtocol::_max_attempts + 0u, static_cast<unsigned long long>(logAttempts),
+      stats.writes > 0 ? static_cast<double>(logAttempts) / stats.writes : 0);
+    printf("          %.1f successful writes/s, %llu timeouts, %llu errors\n", logSuccesses / seconds,
+      static_cast<unsigned long long>(timeouts), static_cast<unsigned long long>(errors));
+    printLatencies("  latency", logLatencies);
+    printf("filter:   deadband %.2f codes, heartbeat %u ms: skipped %llu of %llu samples (%.1f%%)\n",
+      options.deadband, options.heartbeatMs, static_cast<unsigned long long>(stats.skipped),
+      static_cast<unsigned long long>(stats.samples), stats.samples > 0 ? 100.0 * stats.skipped / stats.samples : 0);
+    printf("connectivity: %llu reconnects, %.1f device-s offline (%.2f%% of device time)\n",
+      static_cast<unsigned long long>(stats.reconnects), stats.offlineMs / 1000.0,
+      100.0 * stats.offlineMs / (options.devices * seconds * 1000));
+
+    // Timeline, by the time each attempt started.
+    int64_t intervalUs = static_cast<int64_t>(options.reportS * 1e6);
+    size_t intervals = static_cast<size_t>(seconds / options.reportS + 1);
+    std::vector<std::vector<uint32_t>> latencies(intervals);
+    std::vector<uint64_t> attempts(intervals), failures(intervals);
+    for (const Attempt& attempt : stats.attempts) {
+      size_t interval = std::min(intervals - 1, static_cast<size_t>(attempt.startUs / intervalUs));
+      attempts[interval]++;
+      failures[interval] += attempt.success ? 0 : 1;
+      if (attempt.success) {
+        latencies[interval].push_back(attempt.latencyUs);
+      }
+    }
+    printf("\n%8s %12s %12s %10s %10s\n", "t (s)", "attempts/s", "failures/s", "p50 ms", "p99 ms");
+    for (size_t i = 0; i < intervals; i++) {
+      if (attempts[i] == 0) {
+        continue;
+      }
+      std::sort(latencies[i].begin(), latencies[i].end());
+      printf("%8.0f %12.1f %12.1f %10.2f %10.2f\n", i * options.reportS, attempts[i] / options.reportS, failures[i] / options.reportS,
+        percentileMs(latencies[i], 0.5), percentileMs(latencies[i], 0.99));
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: fleet-load [--devices N] [--seconds S] [--threads N] [--boot-spread-ms ms] [--skew-pct P]\n"
+                    "                  [--timeout-ms ms] [--report-s S] [--target host:port]\n"
+                    "                  [--polling-ms ms] [--max-entries N] [--deadband codes] [--heartbeat-ms ms] [--adc-step codes]\n"
+                    "                  [--server-threads N] [--server-latency-ms ms]\n"
+                    "                  [--outage start-s:duration-s ...]\n");
+    return 2;
+  }
+
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  if (options.threads == 0) {
+    options.threads = cores;
+  }
+  if (options.serverThreads == 0) {
+    options.serverThreads = cores;
+  }
+
+  // Each device holds a socket (and the stand-in holds the other end.)
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < 2 * options.devices + 64) {
+      fprintf(stderr, "warning: open file limit %llu is too low for %u devices\n",
+        static_cast<unsigned long long>(limit.rlim_cur), options.devices);
+    }
+  }
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  std::unique_ptr<StandInServer> server;
+  if (options.target.empty()) {
+    server.reset(new StandInServer(options));
+    if (!server->start(options.serverThreads)) {
+      return 1;
+    }
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(server->getPort());
+  } else {
+    size_t colon = options.target.rfind(':');
+    if (colon == std::string::npos
+      || inet_pton(AF_INET, options.target.substr(0, colon).c_str(), &address.sin_addr) != 1) {
+      fprintf(stderr, "--target must be <IPv4 address>:<port>\n");
+      return 2;
+    }
+    address.sin_port = htons(atoi(options.target.c_str() + colon + 1));
+  }
+
+  // Shard the devices across event loops.
+  std::vector<std::unique_ptr<DeviceLoop>> loops;
+  for (unsigned i = 0; i < options.threads; i++) {
+    uint32_t count = options.devices / options.threads + (i < options.devices % options.threads ? 1 : 0);
+    loops.emplace_back(new DeviceLoop(options, address, count, i + 1));
+  }
+
+  int64_t startUs = nowUs();
+  int64_t endUs = startUs + static_cast<int64_t>(options.seconds * 1e6);
+  std::vector<std::thread> threads;
+  for (auto& loop : loops) {
+    threads.emplace_back([&loop, endUs]() { loop->run(endUs); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  FleetStats stats;
+  for (auto& loop : loops) {
+    stats.merge(loop->getStats());
+  }
+  report(options, stats, (nowUs() - startUs) / 1e6);
+  if (server) {
+    printf("\nstand-in: %llu requests, %llu unanswered (outage)\n",
+      static_cast<unsigned long long>(server->getRequests()), static_cast<unsigned long long>(server->getDropped()));
+  }
+  return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * log-archive - Converts exported Firebase 'log' JSON into an indexed, columnar archive and
+ * answers time-range queries against it.
+ *
+ *    log-archive ingest <archive dir> [export.json]
+ *        Streams the export (or stdin) into new chunks.  Accepts either the 'log' subtree or
+ *        a full database export containing a 'log' member (other members, such as 'config',
+ *        are ignored.)  Records already in the archive are skipped, so successive exports can
+ *        be ingested into the same archive.
+ *
+ *    log-archive query <archive dir> <from ms> <to ms>
+ *        Writes 'time,adc0,adc1,active,skipped' for each record in the range, reading only the
+ *        chunks whose time range overlaps it.
+ *
+ *    log-archive info <archive dir>
+ *        Lists the chunks in the archive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+#include "../firmware/JsonReader.h"
+#include "LogArchive.h"
+
+namespace {
+  // 'JsonReader' source over a stdio stream.
+  class FileSource {
+    private:
+      FILE* _file;
+
+    public:
+      FileSource(FILE* file) : _file(file) { }
+
+      int read() {
+        int ch = getc_unlocked(_file);
+        return ch == EOF ? -1 : ch;
+      }
+  };
+
+  typedef JsonReader<FileSource> Reader;
+
+  struct IngestStats {
+    size_t entries = 0;
+    size_t malformed = 0;
+  };
+
+  bool parseInt64(const char* text, int64_t& value) {
+    char* end;
+    value = strtoll(text, &end, 10);
+    if (*end != '\0') {
+      value = static_cast<int64_t>(strtod(text, &end));
+    }
+    return end != text && *end == '\0';
+  }
+
+  // Parses the remainder of a log entry object (the '{' has been consumed) and adds it to
+  // 'writer' if it has all of the expected fields.
+  bool ingestEntry(Reader& reader, LogArchiveWriter& writer, IngestStats& stats) {
+    LogRecord record = {};
+    bool hasTime = false, has0 = false, has1 = false;
+
+    JsonToken token;
+    while ((token = reader.next()) == JSON_KEY) {
+      char key[8];
+      strncpy(key, reader.text(), sizeof(key) - 1);
+      key[sizeof(key) - 1] = '\0';
+
+      token = reader.next();
+      if (strcmp(key, "time") == 0 && token == JSON_NUMBER) {
+        hasTime = parseInt64(reader.text(), record.time);
+      } else if (strcmp(key, "0") == 0 && token == JSON_NUMBER) {
+        record.adc0 = static_cast<float>(atof(reader.text()));
+        has0 = true;
+      } else if (strcmp(key, "1") == 0 && token == JSON_NUMBER) {
+        record.adc1 = static_cast<float>(atof(reader.text()));
+        has1 = true;
+      } else if (strcmp(key, "active") == 0 && (token == JSON_TRUE || token == JSON_FALSE)) {
+        record.active = token == JSON_TRUE;
+      } else if (strcmp(key, "skipped") == 0 && token == JSON_NUMBER) {
+        record.skipped = static_cast<uint32_t>(strtoul(reader.text(), nullptr, 10));
+      } else if (!reader.skipValue(token)) {
+        return false;
+      }
+    }
+
+    if (token != JSON_END_OBJECT) {
+      return false;
+    }
+
+    stats.entries++;
+    if (!(hasTime && has0 && has1)) {
+      stats.malformed++;
+      return true;
+    }
+    return writer.add(record);
+  }
+
+  // True if 'key' could name a log entry (the device writes entries to 'log/<n>'.)
+  bool isEntryKey(const char* key) {
+    if (*key == '\0') {
+      return false;
+    }
+    for (; *key != '\0'; key++) {
+      if (*key < '0' || *key > '9') {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Parses the remainder of a container of log entries (the '{' or '[' has been consumed.)
+  // At the top level, a 'log' member is itself treated as a container of entries, and members
+  // that are neither 'log' nor entries (e.g., 'config') are skipped.
+  bool ingestEntries(Reader& reader, LogArchiveWriter& writer, IngestStats& stats, bool isTopLevel) {
+    JsonToken token;
+    for (;;) {
+      token = reader.next();
+
+      bool isLog = false;
+      bool isOther = false;
+      if (token == JSON_KEY) {
+        isLog = isTopLevel && strcmp(reader.text(), "log") == 0;
+        isOther = isTopLevel && !isLog && !isEntryKey(reader.text());
+        token = reader.next();
+      }
+
+      if (token == JSON_END_OBJECT || token == JSON_END_ARRAY) {
+        return true;
+      }
+
+      if (isOther) {
+        if (!reader.skipValue(token)) {
+          return false;
+        }
+      } else if (isLog && (token == JSON_BEGIN_OBJECT || token == JSON_BEGIN_ARRAY)) {
+        if (!ingestEntries(reader, writer, stats, /* isTopLevel = */ false)) {
+          return false;
+        }
+      } else if (token == JSON_BEGIN_OBJECT) {
+        if (!ingestEntry(reader, writer, stats)) {
+          return false;
+        }
+      } else if (!reader.skipValue(token)) {     // e.g., 'null' holes in an array export.
+        return false;
+      }
+    }
+  }
+
+  int ingest(const char* directory, const char* exportPath) {
+    FILE* file = exportPath ? fopen(exportPath, "r") : stdin;
+    if (!file) {
+      fprintf(stderr, "Could not open '%s'\n", exportPath);
+      return 1;
+    }
+
+    LogArchiveWriter writer(directory);
+    if (!writer.open()) {
+      return 1;
+    }
+
+    FileSource source(file);
+    Reader reader(source);
+    IngestStats stats;
+
+    JsonToken token = reader.next();
+    bool success = (token == JSON_BEGIN_OBJECT || token == JSON_BEGIN_ARRAY)
+      && ingestEntries(reader, writer, stats, /* isTopLevel = */ true);
+    if (!success) {
+      fprintf(stderr, "Malformed JSON near entry %zu\n", stats.entries);
+    }
+
+    success &= writer.close();
+    if (file != stdin) {
+      fclose(file);
+    }
+
+    fprintf(stderr, "%zu entries: %zu added, %zu already archived, %zu malformed\n",
+      stats.entries, writer.getAdded(), writer.getSkipped(), stats.malformed);
+    return success ? 0 : 1;
+  }
+
+  int query(const char* directory, const char* fromText, const char* toText) {
+    int64_t from, to;
+    if (!parseInt64(fromText, from) || !parseInt64(toText, to)) {
+      fprintf(stderr, "Times must be UTC milliseconds since 1970\n");
+      return 2;
+    }
+
+    LogArchiveReader reader;
+    if (!reader.open(directory)) {
+      return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<LogRecord> records;
+    if (!reader.query(from, to, records)) {
+      return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const LogRecord& record : records) {
+      printf("%" PRId64 ",%g,%g,%d,%" PRIu32 "\n", record.time, record.adc0, record.adc1, record.active ? 1 : 0, record.skipped);
+    }
+
+    fprintf(stderr, "%zu records from %zu of %zu chunks in %.3f s\n",
+      records.size(), reader.getChunksRead(), reader.getChunks().size(), seconds);
+    return 0;
+  }
+
+  int info(const char* directory) {
+    std::vector<LogChunkInfo> chunks;
+    if (!readLogArchiveIndex(directory, chunks)) {
+      return 1;
+    }
+
+    for (const LogChunkInfo& chunk : chunks) {
+      printf("%s: %" PRIu32 " records, %" PRId64 "..%" PRId64 "\n", chunk.fileName.c_str(), chunk.count, chunk.minTime, chunk.maxTime);
+    }
+    return 0;
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 3 && argc <= 4 && strcmp(argv[1], "ingest") == 0) {
+    return ingest(argv[2], argc == 4 ? argv[3] : nullptr);
+  }
+  if (argc == 5 && strcmp(argv[1], "query") == 0) {
+    return query(argv[2], argv[3], argv[4]);
+  }
+  if (argc == 3 && strcmp(argv[1], "info") == 0) {
+    return info(argv[2]);
+  }
+
+  fprintf(stderr, "usage: log-archive ingest <dir> [export.json] | query <dir> <from ms> <to ms> | info <dir>\n");
+  return 2;
+}
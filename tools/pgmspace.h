@@ -0,0 +1,15 @@
+#ifndef __HOST_PGMSPACE_H__
+#define __HOST_PGMSPACE_H__
+
+/*
+ * pgmspace.h - Host stand-in for the ESP8266 SDK's '<pgmspace.h>' (see 'HostArduino.h'.)  The
+ * host has no separate flash address space, so 'PROGMEM' data is ordinary memory.
+ */
+
+#include <string.h>
+
+#define PROGMEM
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+
+#endif // __HOST_PGMSPACE_H__
@@ -0,0 +1,339 @@
+/*
+ * replay - Replays recorded ADC logs through the firmware's control logic for a grid of
+ * parameter sets, to see how 'deltaTOn', 'deltaTOff', 'minTOn', 'maxTOn' and the averaging
+ * window would have behaved against real data.
+ *
+ *    replay --archive <dir> [--from ms] [--to ms] [grid options] [coefficients] [--threads N]
+ *
+ * Grid options take a single value, a comma separated list, or 'first:last:step':
+ *
+ *    --deltaTOn 5:15:0.5  --deltaTOff -2:4:0.5  --minTOn 10  --maxTOn 30:36:1  --window 1,2,4
+ *
+ * '--window N' averages N consecutive logged records per decision, each weighted by how long it
+ * held its value (until the next record.)  (Logged records are already averages of 'oversample'
+ * readings, so this is the nearest replayable equivalent of raising 'oversample' and
+ * 'pollingMilliseconds' together.)
+ *
+ * Each scenario walks every step of its series, so the run time is proportional to scenarios x
+ * records: about a minute for 10K scenarios over 1.5M records (87 days at 5 s) on one core,
+ * divided by the number of cores used.
+ *
+ * Writes one CSV line per parameter set:
+ *
+ *    deltaTOn,deltaTOff,minTOn,maxTOn,window,cyclesPerDay,engagedHours,hoursAboveMaxTOn
+ *
+ * Note: The logged temperatures reflect what the relay actually did, so the replay cannot
+ *       model how a different relay schedule would have changed the temperatures themselves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "HostArduino.h"
+#include "../firmware/Thermistor.h"
+#include "../firmware/Controller.h"
+#include "LogArchive.h"
+#include "WorkStealingPool.h"
+
+namespace {
+  // One decision point: temperatures converted exactly as the firmware would.
+  struct Step {
+    double t0;                        // Pool (Celsius)
+    double t1;                        // Collector (Celsius)
+    int64_t duration;                 // Milliseconds until the next step (0 across gaps in the log.)
+  };
+
+  struct Series {
+    std::vector<Step> steps;
+    int64_t coveredMs = 0;            // Sum of 'duration'.
+  };
+
+  struct Scenario {
+    ControlParameters params;
+    int window;
+  };
+
+  struct Outcome {
+    double cyclesPerDay;
+    double engagedHours;
+    double hoursAboveMaxTOn;
+  };
+
+  struct Options {
+    std::string archive;
+    int64_t from = INT64_MIN;
+    int64_t to = INT64_MAX;
+    std::map<std::string, std::vector<double>> grid = {
+      { "deltaTOn",   { 10 } },
+      { "deltaTOff",  { 0 } },
+      { "minTOn",     { 10 } },
+      { "maxTOn",     { 35 } },
+      { "window",     { 1 } },
+    };
+    double rs = 8170;
+    double r0 = 9555.55;
+    double t0 = 25;
+    double b = 3380;
+    int64_t maxGapMs = 10 * 60 * 1000; // Longer gaps (device offline) are not counted.  Must exceed 'heartbeatMilliseconds'.
+    unsigned threads = 0;
+  };
+
+  // Parses "v", "v1,v2,...", or "first:last:step" into 'values'.
+  bool parseRange(const char* text, std::vector<double>& values) {
+    values.clear();
+
+    double first, last, step;
+    if (sscanf(text, "%lf:%lf:%lf", &first, &last, &step) == 3) {
+      if (step <= 0 || last < first) {
+        return false;
+      }
+      // Compute each value from 'first' rather than accumulating, to avoid drift.
+      for (int i = 0; first + i * step <= last + step * 1e-9; i++) {
+        values.push_back(first + i * step);
+      }
+      return true;
+    }
+
+    std::string list(text);
+    size_t start = 0;
+    while (start <= list.size()) {
+      size_t end = list.find(',', start);
+      if (end == std::string::npos) {
+        end = list.size();
+      }
+      char* parsedEnd;
+      std::string item = list.substr(start, end - start);
+      values.push_back(strtod(item.c_str(), &parsedEnd));
+      if (item.empty() || *parsedEnd != '\0') {
+        return false;
+      }
+      start = end + 1;
+    }
+    return !values.empty();
+  }
+
+  bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+      const char* name = argv[i];
+      const char* value = argv[i + 1];
+      if (strncmp(name, "--", 2) != 0) {
+        return false;
+      }
+
+      std::string key(name + 2);
+      if (options.grid.count(key)) {
+        if (!parseRange(value, options.grid[key])) {
+          fprintf(stderr, "Invalid range for %s: '%s'\n", name, value);
+          return false;
+        }
+      }
+      else if (key == "archive")  { options.archive = value; }
+      else if (key == "from")     { options.from = strtoll(value, nullptr, 10); }
+      else if (key == "to")       { options.to = strtoll(value, nullptr, 10); }
+      else if (key == "rs")       { options.rs = atof(value); }
+      else if (key == "r0")       { options.r0 = atof(value); }
+      else if (key == "t0")       { options.t0 = atof(value); }
+      else if (key == "b")        { options.b = atof(value); }
+      else if (key == "maxGap")   { options.maxGapMs = strtoll(value, nullptr, 10); }
+      else if (key == "threads")  { options.threads = atoi(value); }
+      else { return false; }
+    }
+    return (argc % 2) == 1 && !options.archive.empty();
+  }
+
+  // How long 'records[i]' holds its value: until the next record, or 0 if there is none or the
+  // device was offline in between (a gap longer than 'maxGapMs'.)
+  int64_t holdMs(const std::vector<LogRecord>& records, size_t i, int64_t maxGapMs) {
+    if (i + 1 >= records.size()) {
+      return 0;
+    }
+    int64_t hold = records[i + 1].time - records[i].time;
+    return hold > maxGapMs ? 0 : hold;
+  }
+
+  // Averages each 'window' consecutive records and converts them to temperatures.  Each record
+  // is weighted by how long it holds its value ('holdMs()'), since the upload deadband logs
+  // unchanged readings less often.  (A window that holds for no time is averaged unweighted.)
+  Series buildSeries(const std::vector<LogRecord>& records, int window, Thermistor& thermistor, int64_t maxGapMs) {
+    Series series;
+    for (size_t i = 0; i + window <= records.size(); i += window) {
+      double adc0 = 0, adc1 = 0, weights = 0;
+      for (int j = 0; j < window; j++) {
+        double weight = static_cast<double>(holdMs(records, i + j, maxGapMs));
+        adc0 += records[i + j].adc0 * weight;
+        adc1 += records[i + j].adc1 * weight;
+        weights += weight;
+      }
+      if (weights == 0) {
+        adc0 = adc1 = 0;
+        for (int j = 0; j < window; j++) {
+          adc0 += records[i + j].adc0;
+          adc1 += records[i + j].adc1;
+        }
+        weights = window;
+      }
+
+      Step step;
+      step.t0 = thermistor.toReading(adc0 / weights)._celsius;
+      step.t1 = thermistor.toReading(adc1 / weights)._celsius;
+
+      // The step lasts until the next decision (the first record of the next window.)
+      size_t next = i + window;
+      int64_t duration = next < records.size()
+        ? records[next].time - records[i].time
+        : 0;
+      bool hasGap = false;
+      for (size_t j = i + 1; j <= next && j < records.size(); j++) {
+        hasGap |= records[j].time - records[j - 1].time > maxGapMs;
+      }
+      step.duration = hasGap ? 0 : duration;
+
+      series.coveredMs += step.duration;
+      series.steps.push_back(step);
+    }
+    return series;
+  }
+
+  // Replay state for one scenario.
+  struct Replay {
+    ControlParameters params;
+    bool engaged = false;
+    uint32_t cycles = 0;
+    int64_t engagedMs = 0;
+    int64_t aboveMaxMs = 0;
+
+    // Runs the firmware's decision logic over steps [first, last).
+    void run(const Step* first, const Step* last) {
+      for (const Step* step = first; step != last; step++) {
+        CollectorReason reason;
+        CollectorTransition transition = getCollectorTransition(params, step->t0, step->t1, reason);
+        if (transition == CollectorTransition::ENGAGE) {
+          cycles += engaged ? 0 : 1;
+          engaged = true;
+        } else if (transition == CollectorTransition::DISENGAGE) {
+          engaged = false;
+        }
+
+        engagedMs += engaged ? step->duration : 0;
+        aboveMaxMs += step->t0 > params.maxTOn ? step->duration : 0;
+      }
+    }
+
+    Outcome summarize(const Series& series) const {
+      const double msPerHour = 60.0 * 60 * 1000;
+      double days = series.coveredMs / (24 * msPerHour);
+      return Outcome {
+        days > 0 ? cycles / days : 0,
+        engagedMs / msPerHour,
+        aboveMaxMs / msPerHour,
+      };
+    }
+  };
+
+  // Replays 'scenarios[first..last)' (which must share a window) over 'series'.  The series is
+  // walked in cache-sized blocks, running every scenario over a block before moving on, so
+  // each step is read from memory once per batch rather than once per scenario.
+  void replayBatch(const Series& series, const std::vector<Scenario>& scenarios, size_t first, size_t last, std::vector<Outcome>& outcomes) {
+    const size_t blockSteps = 4096;     // 96KB of 'Step's: fits in L2.
+
+    std::vector<Replay> replays(last - first);
+    for (size_t i = first; i < last; i++) {
+      replays[i - first].params = scenarios[i].params;
+    }
+
+    const Step* steps = series.steps.data();
+    for (size_t begin = 0; begin < series.steps.size(); begin += blockSteps) {
+      size_t end = std::min(series.steps.size(), begin + blockSteps);
+      for (Replay& replay : replays) {
+        replay.run(steps + begin, steps + end);
+      }
+    }
+
+    for (size_t i = first; i < last; i++) {
+      outcomes[i] = replays[i - first].summarize(series);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: replay --archive <dir> [--from ms] [--to ms] [--deltaTOn R] [--deltaTOff R] [--minTOn R] [--maxTOn R] [--window R]\n"
+                    "              [--rs R] [--r0 R] [--t0 C] [--b B] [--maxGap ms] [--threads N]\n");
+    return 2;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  LogArchiveReader reader;
+  std::vector<LogRecord> records;
+  if (!reader.open(options.archive) || !reader.query(options.from, options.to, records)) {
+    return 1;
+  }
+
+  Thermistor thermistor;
+  thermistor.init(options.rs, options.r0, options.t0, options.b);
+
+  // Temperatures depend only on the window, so convert once per window and share the result
+  // (read-only) between all scenarios.
+  std::map<int, Series> seriesByWindow;
+  for (double window : options.grid["window"]) {
+    if (window < 1) {
+      fprintf(stderr, "--window must be >= 1\n");
+      return 2;
+    }
+    seriesByWindow[static_cast<int>(window)] = buildSeries(records, static_cast<int>(window), thermistor, options.maxGapMs);
+  }
+
+  // Scenarios are grouped by window so that each batch shares a series.
+  std::vector<Scenario> scenarios;
+  for (double window : options.grid["window"]) {
+    for (double deltaTOn : options.grid["deltaTOn"]) {
+      for (double deltaTOff : options.grid["deltaTOff"]) {
+        for (double minTOn : options.grid["minTOn"]) {
+          for (double maxTOn : options.grid["maxTOn"]) {
+            scenarios.push_back(Scenario { { minTOn, maxTOn, deltaTOn, deltaTOff }, static_cast<int>(window) });
+          }
+        }
+      }
+    }
+  }
+
+  // Batch scenarios into tasks large enough to amortize scheduling, small enough to balance.
+  std::vector<Outcome> outcomes(scenarios.size());
+  {
+    WorkStealingPool pool(options.threads);
+    const size_t batch = 32;
+    for (size_t first = 0; first < scenarios.size(); ) {
+      // End the batch early where the window changes.
+      size_t last = first + 1;
+      while (last < scenarios.size() && last - first < batch && scenarios[last].window == scenarios[first].window) {
+        last++;
+      }
+
+      const Series& series = seriesByWindow.at(scenarios[first].window);
+      pool.submit([&series, &scenarios, &outcomes, first, last]() {
+        replayBatch(series, scenarios, first, last, outcomes);
+      });
+      first = last;
+    }
+    pool.wait();
+  }
+
+  printf("deltaTOn,deltaTOff,minTOn,maxTOn,window,cyclesPerDay,engagedHours,hoursAboveMaxTOn\n");
+  for (size_t i = 0; i < scenarios.size(); i++) {
+    const ControlParameters& p = scenarios[i].params;
+    const Outcome& o = outcomes[i];
+    printf("%g,%g,%g,%g,%d,%.2f,%.2f,%.2f\n", p.deltaTOn, p.deltaTOff, p.minTOn, p.maxTOn, scenarios[i].window,
+      o.cyclesPerDay, o.engagedHours, o.hoursAboveMaxTOn);
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  fprintf(stderr, "%zu scenarios over %zu records in %.2f s\n", scenarios.size(), records.size(), seconds);
+  return 0;
+}
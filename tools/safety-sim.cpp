@@ -0,0 +1,262 @@
+/*
+ * safety-sim - Measures how long the firmware takes to open the relay after a temperature
+ * crosses 'maxTOn' (or 'minTOn'), comparing the per-sample 'SafetyCutoff.h' path with the
+ * decision made on the averaged samples at the end of each polling period.
+ *
+ *    safety-sim [--condition hot|cold] [--polling-ms 5000] [--oversample 16] [--block-ms 400]
+ *               [--watch 1] [--ramp-c-per-min 1] [--noise 2] [--spike-rate 0.001] [--trials 100000]
+ *
+ * The simulated 'loop()' follows firmware.ino: 'oversample' samples 'pollingMilliseconds /
+ * oversample' apart, the averaged decision, then '--block-ms' spent logging to Firebase (a
+ * successful 'CloudStorage::log()' is a few hundred ms; 3 failed attempts against the HTTP
+ * client's 5 s timeout is about 15 s.)  While blocked, 'SafetyWatch.h' keeps sampling at the same
+ * interval ('--watch 0' models the loop without it.)
+ *
+ * Each trial starts the temperature ramp at a random phase of the loop.  ADC samples have
+ * Gaussian noise ('--noise' codes) plus occasional full-scale spikes ('--spike-rate'.)  Latencies
+ * include trips before the crossing (negative, from noise near the limit), which are also
+ * counted separately from trials that never tripped.  Also reports false trips while the
+ * temperature sits 1 Celsius inside the safe range.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "HostArduino.h"
+#include "../firmware/Thermistor.h"
+#include "../firmware/Controller.h"
+#include "../firmware/SafetyCutoff.h"
+
+namespace {
+  struct Options {
+    bool hot = true;
+    double pollingMs = 5000;
+    int oversample = 16;
+    double blockMs = 400;
+    bool watch = true;
+    double rampCPerMin = 1;
+    double noise = 2;
+    double spikeRate = 0.001;
+    int trials = 100000;
+    ControlParameters params = { 10, 35, 10, 0 };
+  };
+
+  bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+      std::string key(argv[i]);
+      const char* value = argv[i + 1];
+      if      (key == "--condition")        { options.hot = strcmp(value, "cold") != 0; }
+      else if (key == "--polling-ms")       { options.pollingMs = atof(value); }
+      else if (key == "--oversample")       { options.oversample = atoi(value); }
+      else if (key == "--block-ms")         { options.blockMs = atof(value); }
+      else if (key == "--watch")            { options.watch = atoi(value) != 0; }
+      else if (key == "--ramp-c-per-min")   { options.rampCPerMin = atof(value); }
+      else if (key == "--noise")            { options.noise = atof(value); }
+      else if (key == "--spike-rate")       { options.spikeRate = atof(value); }
+      else if (key == "--trials")           { options.trials = atoi(value); }
+      else if (key == "--minTOn")           { options.params.minTOn = atof(value); }
+      else if (key == "--maxTOn")           { options.params.maxTOn = atof(value); }
+      else { return false; }
+    }
+    return (argc % 2) == 1 && options.oversample > 0 && options.trials > 0 && options.rampCPerMin > 0;
+  }
+
+  // Produces the integer ADC code the device would read at a given temperature.
+  class Sensor {
+    private:
+      Thermistor& _thermistor;
+      const Options& _options;
+      std::mt19937_64 _random;
+      std::normal_distribution<double> _noise;
+      std::uniform_real_distribution<double> _uniform;
+
+    public:
+      Sensor(Thermistor& thermistor, const Options& options, uint64_t seed)
+        : _thermistor(thermistor), _options(options), _random(seed), _noise(0, options.noise), _uniform(0, 1) { }
+
+      int32_t read(double celsius) {
+        if (_uniform(_random) < _options.spikeRate) {
+          return _uniform(_random) < 0.5 ? 0 : 1023;
+        }
+        double adc = _thermistor.celsiusToAdc(celsius) + _noise(_random);
+        return static_cast<int32_t>(std::min(1023.0, std::max(0.0, round(adc))));
+      }
+
+      double uniform() {
+        return _uniform(_random);
+      }
+  };
+
+  // Outcomes of one path (the per-sample cutoff or the averaged decision) over all trials.
+  struct PathResults {
+    std::vector<double> latencies;        // ms from the crossing to the trip (negative if before it.)
+    int early = 0;                        // Trips before the crossing (noise.)
+    int missed = 0;                       // Trials that never tripped.
+  };
+
+  // When a path tripped, if it did.
+  struct Trip {
+    bool tripped = false;
+    double ms = 0;                        // Relative to the crossing.
+
+    void record(double t) {
+      if (!tripped) {
+        tripped = true;
+        ms = t;
+      }
+    }
+  };
+
+  void add(const Trip& trip, PathResults& results) {
+    if (!trip.tripped) {
+      results.missed++;
+      return;
+    }
+    results.latencies.push_back(trip.ms);
+    results.early += trip.ms < 0 ? 1 : 0;
+  }
+
+  // Temperatures of the pool and collector at time 't', for a ramp crossing the limit at 'crossMs'.
+  // Before the ramp, the temperature holds 2 Celsius inside the limit (so a fast ramp is a step.)
+  void temperatures(const Options& options, double t, double crossMs, double& pool, double& collector) {
+    double ramp = std::max(-2.0, options.rampCPerMin * (t - crossMs) / 60000.0);
+    if (options.hot) {
+      pool = options.params.maxTOn + ramp;                    // Pool rising through 'maxTOn'.
+      collector = pool + 5;
+    } else {
+      pool = options.params.minTOn + 10;
+      collector = options.params.minTOn - ramp;               // Collector falling through 'minTOn'.
+    }
+  }
+
+  // Runs one trial: the crossing happens at a uniformly random point in the loop's cycle.  A
+  // path that doesn't trip within an hour of the crossing is counted as missed.
+  void runTrial(const Options& options, Thermistor& thermistor, Sensor& sensor, PathResults& fast, PathResults& averaged) {
+    double sampleMs = floor(options.pollingMs / options.oversample);
+    double cycleMs = sampleMs * options.oversample + options.blockMs;
+    double crossMs = cycleMs * (2 + sensor.uniform());        // Let the cutoff's history fill first.
+
+    SafetyCutoff safety;
+    SafetyThresholds thresholds = SafetyCutoff::computeThresholds(thermistor, options.params.minTOn, options.params.maxTOn);
+
+    Trip fastTrip, averagedTrip;
+    for (double t = 0; t < crossMs + 3600000 && (!fastTrip.tripped || !averagedTrip.tripped); ) {
+      double sum[2] = {};
+      for (int i = 0; i < options.oversample; i++) {
+        t += sampleMs;
+        double celsius[2];
+        temperatures(options, t, crossMs, celsius[0], celsius[1]);
+        for (int channel = 0; channel < 2; channel++) {
+          int32_t adc = sensor.read(celsius[channel]);
+          sum[channel] += adc;
+          if (safety.check(thresholds, channel, adc)) {
+            fastTrip.record(t - crossMs);
+          }
+        }
+      }
+
+      CollectorReason reason;
+      double t0 = thermistor.toReading(sum[0] / options.oversample)._celsius;
+      double t1 = thermistor.toReading(sum[1] / options.oversample)._celsius;
+      if ((getCollectorTransition(options.params, t0, t1, reason) == CollectorTransition::DISENGAGE)
+        && (reason == ABOVE_MAX_T || reason == BELOW_MIN_T)) {
+        averagedTrip.record(t - crossMs);
+      }
+
+      // 'SafetyWatch' samples every 'sampleMs' while 'loop()' is blocked.
+      double blockEnd = t + options.blockMs;
+      for (t += sampleMs; options.watch && t <= blockEnd; t += sampleMs) {
+        double celsius[2];
+        temperatures(options, t, crossMs, celsius[0], celsius[1]);
+        for (int channel = 0; channel < 2; channel++) {
+          if (safety.check(thresholds, channel, sensor.read(celsius[channel]))) {
+            fastTrip.record(t - crossMs);
+          }
+        }
+      }
+      t = blockEnd;
+    }
+
+    add(fastTrip, fast);
+    add(averagedTrip, averaged);
+  }
+
+  // Counts trips per day while the temperature holds 1 Celsius inside the safe range.
+  double falseTripsPerDay(const Options& options, Thermistor& thermistor, Sensor& sensor) {
+    SafetyCutoff safety;
+    SafetyThresholds thresholds = SafetyCutoff::computeThresholds(thermistor, options.params.minTOn, options.params.maxTOn);
+
+    double celsius[2];
+    temperatures(options, 0, 60000.0 / options.rampCPerMin, celsius[0], celsius[1]);
+
+    const double days = 30;
+    double sampleMs = floor(options.pollingMs / options.oversample);
+    double cycleMs = sampleMs * options.oversample + options.blockMs;
+    long watched = options.watch ? static_cast<long>(options.blockMs / sampleMs) : 0;
+    long samples = static_cast<long>(days * 86400000.0 / cycleMs) * (options.oversample + watched);
+
+    long trips = 0;
+    bool wasTripped = false;
+    for (long i = 0; i < samples; i++) {
+      for (int channel = 0; channel < 2; channel++) {
+        safety.check(thresholds, channel, sensor.read(celsius[channel]));
+      }
+      trips += safety.isTripped() && !wasTripped ? 1 : 0;
+      wasTripped = safety.isTripped();
+    }
+    return trips / days;
+  }
+
+  // 'values' must be sorted.
+  double percentile(const std::vector<double>& values, double p) {
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    return values[index];
+  }
+
+  void report(const char* name, PathResults& results) {
+    std::vector<double>& values = results.latencies;
+    if (values.empty()) {
+      printf("%-10s never tripped (%d missed)\n", name, results.missed);
+      return;
+    }
+
+    std::sort(values.begin(), values.end());
+    double sum = 0;
+    for (double value : values) {
+      sum += value;
+    }
+    printf("%-10s mean %8.0f ms   p50 %8.0f ms   p99 %8.0f ms   max %8.0f ms   min %8.0f ms   (%d before the crossing, %d missed)\n",
+      name, sum / values.size(), percentile(values, 0.5), percentile(values, 0.99), values.back(), values.front(),
+      results.early, results.missed);
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: safety-sim [--condition hot|cold] [--polling-ms ms] [--oversample N] [--block-ms ms] [--watch 0|1]\n"
+                    "                  [--ramp-c-per-min C] [--noise codes] [--spike-rate p] [--trials N] [--minTOn C] [--maxTOn C]\n");
+    return 2;
+  }
+
+  Thermistor thermistor;
+  thermistor.init(8170, 9555.55, 25, 3380);   // Defaults from 'Config.h'.
+  Sensor sensor(thermistor, options, 1);
+
+  PathResults fast, averaged;
+  for (int i = 0; i < options.trials; i++) {
+    runTrial(options, thermistor, sensor, fast, averaged);
+  }
+
+  printf("%s crossing at %.2f C/min, sample every %.0f ms, %.0f ms blocked per period (%s), %d trials\n",
+    options.hot ? "maxTOn" : "minTOn", options.rampCPerMin, floor(options.pollingMs / options.oversample),
+    options.blockMs, options.watch ? "watched" : "unwatched", options.trials);
+  report("per-sample", fast);
+  report("averaged", averaged);
+  printf("false trips at 1 C inside the limit: %.2f/day\n", falseTripsPerDay(options, thermistor, sensor));
+  return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef __HOST_SNTP_H__
+#define __HOST_SNTP_H__
+
+/*
+ * sntp.h - Host stand-in for the ESP8266 SDK's '<sntp.h>' (see 'HostArduino.h'.)  Tools that
+ * include 'Clock.h' define 'sntp_get_current_timestamp()' to simulate the SDK's clock.
+ */
+
+#include <stdint.h>
+
+uint32_t sntp_get_current_timestamp();
+
+#endif // __HOST_SNTP_H__
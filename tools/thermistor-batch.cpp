@@ -0,0 +1,189 @@
+/*
+ * thermistor-batch - Converts logged ADC values to temperatures in bulk.
+ *
+ *    thermistor-batch convert [options] < adc.txt > celsius.txt
+ *        Reads one ADC value per line and writes 'adc,celsius,fahrenheit' per line.
+ *
+ *    thermistor-batch verify [options]
+ *        Compares each 'ThermistorBatch' path (scalar, and AVX2 if supported) against
+ *        'Thermistor::toReading()' for every ADC value in (0, 1023) at 1/64 steps and reports
+ *        the maximum error, and the maximum difference between the paths.
+ *
+ *    thermistor-batch bench [options] [--count N] [--threads N]
+ *        Reports throughput of 'toCelsiusParallel()' over N pseudo-random ADC values.
+ *
+ * Options (defaults match firmware/Config.h):
+ *    --rs <ohms>  --r0 <ohms>  --t0 <celsius>  --b <coefficient>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "HostArduino.h"
+#include "../firmware/Thermistor.h"
+#include "ThermistorBatch.h"
+
+namespace {
+  struct Options {
+    double rs = 8170;
+    double r0 = 9555.55;
+    double t0 = 25;
+    double b = 3380;
+    size_t count = 100 * 1000 * 1000;
+    unsigned threads = 0;
+  };
+
+  int usage() {
+    fprintf(stderr, "usage: thermistor-batch convert|verify|bench [--rs R] [--r0 R] [--t0 C] [--b B] [--count N] [--threads N]\n");
+    return 2;
+  }
+
+  bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 2; i < argc; i++) {
+      if (i + 1 >= argc) {
+        return false;
+      }
+
+      const char* name = argv[i];
+      const char* value = argv[++i];
+      if (strcmp(name, "--rs") == 0)            { options.rs = atof(value); }
+      else if (strcmp(name, "--r0") == 0)       { options.r0 = atof(value); }
+      else if (strcmp(name, "--t0") == 0)       { options.t0 = atof(value); }
+      else if (strcmp(name, "--b") == 0)        { options.b = atof(value); }
+      else if (strcmp(name, "--count") == 0)    { options.count = strtoull(value, nullptr, 10); }
+      else if (strcmp(name, "--threads") == 0)  { options.threads = atoi(value); }
+      else { return false; }
+    }
+    return true;
+  }
+
+  int convert(const Options& options) {
+    ThermistorBatch batch(options.rs, options.r0, options.t0, options.b);
+
+    std::vector<float> adc;
+    char line[64];
+    while (fgets(line, sizeof(line), stdin)) {
+      adc.push_back(static_cast<float>(atof(line)));
+    }
+
+    std::vector<float> celsius(adc.size());
+    std::vector<float> fahrenheit(adc.size());
+    batch.toCelsiusParallel(adc.data(), celsius.data(), adc.size(), options.threads);
+    batch.toFahrenheit(adc.data(), fahrenheit.data(), adc.size());
+
+    for (size_t i = 0; i < adc.size(); i++) {
+      printf("%g,%.4f,%.4f\n", adc[i], celsius[i], fahrenheit[i]);
+    }
+    return 0;
+  }
+
+  // Compares the current 'ThermistorBatch' path against 'thermistor' over 'adc', writing its
+  // results to 'celsius'.  Returns the maximum error in Celsius.
+  double verifyPath(const Options& options, const Thermistor& thermistor, const std::vector<float>& adc, std::vector<float>& celsius) {
+    ThermistorBatch batch(options.rs, options.r0, options.t0, options.b);
+
+    std::vector<float> ohms(adc.size());
+    batch.toCelsius(adc.data(), celsius.data(), adc.size());
+    batch.toResistance(adc.data(), ohms.data(), adc.size());
+
+    // Limit the comparison to the range where the sensor is plausibly in use.
+    double maxError = 0;
+    double maxRelativeResistanceError = 0;
+    float worstAdc = 0;
+    for (size_t i = 0; i < adc.size(); i++) {
+      ThermistorReading expected = thermistor.toReading(adc[i]);
+      bool isEndPoint = adc[i] <= 0 || adc[i] >= 1023;
+      if (!isEndPoint && (expected._celsius < -40 || expected._celsius > 125)) {
+        continue;
+      }
+
+      double error = fabs(celsius[i] - expected._celsius);
+      if (error > maxError) {
+        maxError = error;
+        worstAdc = adc[i];
+      }
+
+      if (!isEndPoint) {
+        maxRelativeResistanceError = fmax(maxRelativeResistanceError, fabs(ohms[i] - expected._resistance) / expected._resistance);
+      }
+    }
+
+    printf("path: %s\n", ThermistorBatch::isVectorized() ? "avx2" : "scalar");
+    printf("  max celsius error (-40..125 C): %.6f (at adc = %g)\n", maxError, worstAdc);
+    printf("  max relative resistance error: %.3g\n", maxRelativeResistanceError);
+    return maxError;
+  }
+
+  int verify(const Options& options) {
+    Thermistor thermistor;
+    thermistor.init(options.rs, options.r0, options.t0, options.b);
+
+    // Every representable 1/64th step, plus the invalid end points.
+    std::vector<float> adc;
+    for (int i = 0; i <= 1023 * 64; i++) {
+      adc.push_back(i / 64.0f);
+    }
+
+    // Single precision limits us to ~1e-4 C near 100 C.  Anything larger is a bug.
+    const double tolerance = 0.001;
+
+    std::vector<float> scalar(adc.size());
+    ThermistorBatch::setVectorized(false);
+    bool success = verifyPath(options, thermistor, adc, scalar) < tolerance;
+
+    if (ThermistorBatch::setVectorized(true)) {
+      std::vector<float> vector(adc.size());
+      success &= verifyPath(options, thermistor, adc, vector) < tolerance;
+
+      double maxDifference = 0;
+      for (size_t i = 0; i < adc.size(); i++) {
+        double expected = thermistor.toReading(adc[i])._celsius;
+        if (-40 <= expected && expected <= 125) {
+          maxDifference = fmax(maxDifference, fabs(vector[i] - scalar[i]));
+        }
+      }
+      printf("max difference between paths (-40..125 C): %.6f\n", maxDifference);
+    } else {
+      printf("path: avx2 (not supported on this CPU)\n");
+    }
+
+    return success ? 0 : 1;
+  }
+
+  int bench(const Options& options) {
+    ThermistorBatch batch(options.rs, options.r0, options.t0, options.b);
+
+    std::vector<float> adc(options.count);
+    uint32_t seed = 1;
+    for (float& value : adc) {
+      seed = seed * 1664525 + 1013904223;
+      value = 100.0f + (seed >> 8) % (800 * 16) / 16.0f;
+    }
+    std::vector<float> celsius(options.count);
+
+    // Warm up (page in the output buffer), then time.
+    batch.toCelsiusParallel(adc.data(), celsius.data(), adc.size(), options.threads);
+
+    auto start = std::chrono::steady_clock::now();
+    batch.toCelsiusParallel(adc.data(), celsius.data(), adc.size(), options.threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("path: %s\n", ThermistorBatch::isVectorized() ? "avx2" : "scalar");
+    printf("%zu samples in %.3f s: %.1f M samples/s\n", adc.size(), seconds, adc.size() / seconds / 1e6);
+    return 0;
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (argc < 2 || !parseOptions(argc, argv, options)) {
+    return usage();
+  }
+
+  if (strcmp(argv[1], "convert") == 0)  { return convert(options); }
+  if (strcmp(argv[1], "verify") == 0)   { return verify(options); }
+  if (strcmp(argv[1], "bench") == 0)    { return bench(options); }
+  return usage();
+}